@@ -6,227 +6,1008 @@
 #include "chunkmap.h"
 #include "utility/logger.h"
 #include "utility/error.h"
+#include "utility/workers.h"
+#include "kernels.h"
+#include "simplify.h"
 
-void iterateImagePixels(int x, int y, image input, vectorize_options options, chunkmap* output) {
+typedef struct
+{
+    image input;
+    summed_area_table* table;
+    vectorize_options options;
+    chunkmap* output;
+    const pixel_kernels* kernels;
+    const quantize_table* quantize; //snaps the channels of every average, only with options.quantize_chunks
+    palette* colours; //swaps every average for its nearest palette colour instead
+} chunkmap_band_stuff;
+
+const int NEIGHBOUR_X[NEIGHBOUR_COUNT] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+const int NEIGHBOUR_Y[NEIGHBOUR_COUNT] = { -1, -1, -1, 0, 0, 1, 1, 1 };
+
+// Resets a chunk to unfilled, and gives back the chunk's pixel dimensions
+pixelchunk* prepare_chunk(int x, int y, image input, vectorize_options options, chunkmap* output, int* node_width, int* node_height) {
     int x_offset = x * options.chunk_size;
     int y_offset = y * options.chunk_size;
 
     // Grab the pixelchunk
-    pixelchunk* chunk = &output->groups_array_2d[x][y];
-    
-    coordinate location = {
-        x, y,
-    };
-    chunk->location = location;
-    chunk->border_location = (vector2){ 0.f, 0.f };
+    pixelchunk* chunk = get_chunk(output, x, y);
+    chunk->flags = 0;
+    chunk->shape_index = -1;
     
     // Assigned the edge case pixelchunk dimensions
-    int node_width = input.width - x * options.chunk_size;
-    int node_height = input.height - y * options.chunk_size;
+    *node_width = input.width - x_offset;
+    *node_height = input.height - y_offset;
     
     // Check if not actually on the edge
-    if (node_width > options.chunk_size)
-        node_width = options.chunk_size;
+    if (*node_width > options.chunk_size)
+        *node_width = options.chunk_size;
 
-    if (node_height > options.chunk_size)
-        node_height = options.chunk_size;
-    
-    chunk->pixels_array_2d = calloc(1, sizeof(pixel*) * node_width);
-    
-    for(int i = 0; i < node_width; ++i) {
-        chunk->pixels_array_2d[i] = &input.pixels_array_2d[x_offset + i][y_offset];
-    }
+    if (*node_height > options.chunk_size)
+        *node_height = options.chunk_size;
+
+    return chunk;
+}
+
+void iterateImagePixels(int x, int y, image input, vectorize_options options, chunkmap* output, const pixel_kernels* kernels) {
+    int node_width, node_height;
+    pixelchunk* chunk = prepare_chunk(x, y, input, options, output, &node_width, &node_height);
+    pixel* pixels = &get_image_row(input, y * options.chunk_size)[x * options.chunk_size];
     int count = node_width * node_height;
 
     // Calculate the average of all these pixels
-    pixelF average = { 0.f, 0.f, 0.f };
-    int average_r = 0, average_g = 0, average_b = 0;
-    
-    // Also calculate the Minimum and Maximum 'colors' (values of each color)
-    pixel min = { 255, 255, 255 }, max = { 0, 0, 0 };
+    uint32_t sums[3] = { 0, 0, 0 };
 
-    for (int x = 0; x < node_width; ++x)
+    for (int y = 0; y < node_height; ++y)
     {
-        for (int y = 0; y < node_height; ++y)
+        pixel* row = &pixels[(size_t)y * input.stride];
+
+        // rows narrower than one vector are cheaper to add up here than to hand to a kernel
+        if (node_width >= 16)
         {
-            pixel* currentpixel_p = &(input.pixels_array_2d[x_offset + x][y_offset + y]);
-            average_r += currentpixel_p->r;
-            average_g += currentpixel_p->g;
-            average_b += currentpixel_p->b;
+            kernels->sum_pixels(row, node_width, sums);
+            continue;
+        }
 
-            if (currentpixel_p->r < min.r)
-                min.r = currentpixel_p->r;
+        for (int x = 0; x < node_width; ++x)
+        {
+            sums[0] += row[x].r;
+            sums[1] += row[x].g;
+            sums[2] += row[x].b;
+        }
+    }
 
-            if (currentpixel_p->g < min.g)
-                min.g = currentpixel_p->g;
+    pixel average_p = { 
+        (byte)(sums[0] / count), 
+        (byte)(sums[1] / count), 
+        (byte)(sums[2] / count) 
+    };
+    chunk->average_colour = average_p;
+}
 
-            if (currentpixel_p->b < min.b)
-                min.b = currentpixel_p->b;
+void average_chunk_from_table(int x, int y, image input, summed_area_table* table, vectorize_options options, chunkmap* output) {
+    int node_width, node_height;
+    pixelchunk* chunk = prepare_chunk(x, y, input, options, output, &node_width, &node_height);
+    int count = node_width * node_height;
+    int left = x * options.chunk_size;
+    int top = y * options.chunk_size;
 
-            if (currentpixel_p->r > max.r)
-                max.r = currentpixel_p->r;
+    uint32_t* top_left = &table->sums[((size_t)top * table->width + left) * 3];
+    uint32_t* top_right = top_left + (size_t)node_width * 3;
+    uint32_t* bottom_left = top_left + (size_t)node_height * table->width * 3;
+    uint32_t* bottom_right = bottom_left + (size_t)node_width * 3;
 
-            if (currentpixel_p->g > max.g)
-                max.g = currentpixel_p->g;
-                
-            if (currentpixel_p->b > max.b)
-                max.b = currentpixel_p->b;
-        }
-    }
+    // unsigned wraparound cancels out as long as the chunk's own sum fits in 32 bits
+    uint32_t sum_r = bottom_right[0] - bottom_left[0] - top_right[0] + top_left[0];
+    uint32_t sum_g = bottom_right[1] - bottom_left[1] - top_right[1] + top_left[1];
+    uint32_t sum_b = bottom_right[2] - bottom_left[2] - top_right[2] + top_left[2];
 
     pixel average_p = { 
-        (byte)((float)average_r / (float)count), 
-        (byte)((float)average_g / (float)count), 
-        (byte)((float)average_b / (float)count) 
+        (byte)(sum_r / count), 
+        (byte)(sum_g / count), 
+        (byte)(sum_b / count) 
     };
     chunk->average_colour = average_p;
-    chunk->shape_chunk_in = NULL;
-    chunk->boundary_chunk_in = NULL;
 }
 
-chunkmap* generate_chunkmap(image input, vectorize_options options)
+// Quantizes a row of averages right after they were made, while they are still in cache
+void quantize_chunk_row(chunkmap_band_stuff* stuff, int y) {
+    chunkmap* map = stuff->output;
+    pixelchunk* row = get_chunk(map, 0, y);
+
+    if (stuff->colours)
+    {
+        byte* indices = &map->colour_indices[y * map->chunk_stride];
+
+        for (int x = 0; x < map->map_width; ++x)
+        {
+            indices[x] = stuff->colours->lookup[get_palette_cell(row[x].average_colour)];
+            row[x].average_colour = stuff->colours->colours[indices[x]];
+        }
+        return;
+    }
+    const byte* values = stuff->quantize->values;
+
+    for (int x = 0; x < map->map_width; ++x)
+    {
+        pixel* colour = &row[x].average_colour;
+        *colour = (pixel){ values[colour->r], values[colour->g], values[colour->b] };
+    }
+}
+
+void average_chunk_rows(void* userdata, int band_start, int band_end) {
+    chunkmap_band_stuff* stuff = userdata;
+
+    for (int y = band_start; y < band_end; ++y)
+    {
+        for (int x = 0; x < stuff->output->map_width; ++x)
+        {
+            iterateImagePixels(x, y, stuff->input, stuff->options, stuff->output, stuff->kernels);
+        }
+
+        if (stuff->options.quantize_chunks)
+            quantize_chunk_row(stuff, y);
+    }
+}
+
+void average_chunk_rows_from_table(void* userdata, int band_start, int band_end) {
+    chunkmap_band_stuff* stuff = userdata;
+
+    for (int y = band_start; y < band_end; ++y)
+    {
+        for (int x = 0; x < stuff->output->map_width; ++x)
+        {
+            average_chunk_from_table(x, y, stuff->input, stuff->table, stuff->options, stuff->output);
+        }
+
+        if (stuff->options.quantize_chunks)
+            quantize_chunk_row(stuff, y);
+    }
+}
+
+// A byte per chunk laid out like the chunks, the ghost ring stays 0
+byte* create_chunk_byte_grid(chunkmap* map, const char* name)
 {
-    if (!input.pixels_array_2d)
+    byte* grid = calloc((size_t)map->chunk_stride * (map->map_height + 2), sizeof(byte));
+
+    if (!grid)
     {
-        LOG_ERR("Invalid image input");
+        LOG_ERR("could not allocate %s", name);
         setError(ASSUMPTION_WRONG);
         return NULL;
     }
+    return grid + map->chunk_stride + 1;
+}
+
+// Gets the table or palette of options.quantize_chunks ready for the bands, channel_table is where the table goes
+void prepare_chunk_quantizer(chunkmap_band_stuff* stuff, quantize_table* channel_table)
+{
+    vectorize_options options = stuff->options;
+
+    if (options.num_colours < 1 || options.num_colours > MAX_PALETTE_COLOURS)
+    {
+        LOG_ERR("num colours out of bounds!");
+        setError(BAD_ARGUMENT_ERROR);
+        return;
+    }
+
+    if (options.quantize_method != QUANTIZE_PALETTE)
+    {
+        LOG_INFO("quantizing chunk averages to %d colours per channel", options.num_colours);
+        *channel_table = create_quantize_table(options.num_colours);
+        stuff->quantize = channel_table;
+        return;
+    }
+    LOG_INFO("quantizing chunk averages to a palette of %d colours", options.num_colours);
+    stuff->colours = create_palette(stuff->input, options.num_colours, options.kmeans_iterations, options.thread_count);
+
+    if (isBadError())
+    {
+        LOG_ERR("create_palette failed with %d", getLastError());
+        return;
+    }
+    stuff->output->colour_indices = create_chunk_byte_grid(stuff->output, "chunk colour indices");
+}
+
+// Hands the palette over to the map once every chunk has its index
+void finish_chunk_quantizer(chunkmap_band_stuff* stuff)
+{
+    chunkmap* map = stuff->output;
+
+    if (!stuff->colours)
+        return;
+
+    map->palette = arena_alloc(map->allocator, sizeof(palette));
+
+    if (map->palette)
+        *map->palette = *stuff->colours;
+
+    free_palette(stuff->colours);
+    stuff->colours = NULL;
+}
+
+// Averages every chunk in row bands, quantizing them too when asked to
+chunkmap* average_chunks(chunkmap* output, chunkmap_band_stuff* stuff, band_job job)
+{
+    quantize_table channel_table;
+
+    if (stuff->options.quantize_chunks)
+    {
+        prepare_chunk_quantizer(stuff, &channel_table);
+
+        if (isBadError())
+        {
+            LOG_ERR("could not prepare chunk quantizer: %d", getLastError());
+            free_palette(stuff->colours);
+            free_chunkmap(output);
+            return NULL;
+        }
+    }
+    run_in_bands(stuff->options.thread_count, output->map_height, job, stuff);
+    finish_chunk_quantizer(stuff);
+    return output;
+}
 
-    if (input.width < 1 || input.height < 1 || !input.pixels_array_2d)
+bool can_chunk_image(int width, int height, int chunk_size)
+{
+    if (width < 1 || height < 1)
     {
         LOG_ERR("Invalid dimensions or bad image");
         setError(ASSUMPTION_WRONG);
+        return false;
+    }
+
+    if (chunk_size < 1)
+    {
+        LOG_ERR("chunk_size must be at least 1, was %d", chunk_size);
+        setError(BAD_ARGUMENT_ERROR);
+        return false;
+    }
+    return true;
+}
+
+// Only needs the image's dimensions, the pixels may not exist yet
+chunkmap* create_empty_chunkmap(image input, vectorize_options options)
+{
+    if (!can_chunk_image(input.width, input.height, options.chunk_size))
+        return NULL;
+
+    int map_width = (input.width + options.chunk_size - 1) / options.chunk_size; //floats would round widths past 2^24
+    int map_height = (input.height + options.chunk_size - 1) / options.chunk_size;
+
+    // chunks are indexed on the grid with its ghost ring in 32 bits, a bigger image has to go through in bands
+    if ((int64_t)(map_width + 2) * (map_height + 2) > INT32_MAX)
+    {
+        LOG_ERR("%d x %d chunks are too many for one map, decode the image in bands", map_width, map_height);
+        setError(OVERFLOW_ERROR);
         return NULL;
-    }    
+    }
     chunkmap* output = calloc(1, sizeof(chunkmap));
+
+    if (!output)
+    {
+        LOG_ERR("could not allocate chunkmap");
+        setError(ASSUMPTION_WRONG);
+        return NULL;
+    }
     output->input = input;
-    output->map_width = (int)ceilf((float)input.width / (float)options.chunk_size);
-    output->map_height = (int)ceilf((float)input.height / (float)options.chunk_size);
-    
-    LOG_INFO("creating pixelchunk");
-    pixelchunk** newarray = calloc(1, sizeof(pixelchunk*) * output->map_width);
-    output->groups_array_2d = newarray;
-    LOG_INFO("creating chunkshape");
-
-    chunkshape* shape_list = calloc(1, sizeof(chunkshape));
-    shape_list->next = NULL;
-    shape_list->previous = NULL;
-
-    LOG_INFO("allocating boundaries list");
-    pixelchunk_list* boundaries = calloc(1, sizeof(pixelchunk_list));
-    boundaries->firstitem = boundaries;
-    boundaries->chunk_p = NULL;
-    boundaries->next = NULL;
-    shape_list->boundaries = boundaries;
-        
-    LOG_INFO("allocating chunks list");
-    pixelchunk_list* chunks = calloc(1, sizeof(pixelchunk_list));
-    chunks->firstitem = chunks;
-    chunks->chunk_p = NULL;
-    chunks->next = NULL;
-    shape_list->chunks = chunks;
-
-    output->shape_list = shape_list;
-
-    LOG_INFO("allocating row pointers");
-
-    for (int i = 0; i < output->map_width; ++i)
-    {
-        output->groups_array_2d[i] = calloc(1, sizeof(pixelchunk) * output->map_height);
-    }    
-    LOG_INFO("iterating chunkmap pixels");
+    output->map_width = map_width;
+    output->map_height = map_height;
     
-    for (int x = 0; x < output->map_width; ++x)
+    LOG_INFO("creating pixelchunk grid");
+    output->chunk_stride = output->map_width + 2;
+    pixelchunk* grid = calloc((size_t)output->chunk_stride * (output->map_height + 2), sizeof(pixelchunk));
+
+    if (!grid)
+    {
+        LOG_ERR("could not allocate %d x %d pixelchunk grid", output->map_width, output->map_height);
+        setError(ASSUMPTION_WRONG);
+        free(output);
+        return NULL;
+    }
+    output->chunks = grid + output->chunk_stride + 1;
+    output->shape_list = NULL;
+    output->allocator = create_arena();
+
+    for (int i = 0; i < NEIGHBOUR_COUNT; ++i)
     {
-        for (int y = 0; y < output->map_height; ++y)
+        output->neighbour_offsets[i] = NEIGHBOUR_X[i] + NEIGHBOUR_Y[i] * output->chunk_stride;
+    }
+
+    LOG_INFO("marking ghost chunks");
+
+    // ghosts keep a zero colour and are only ever told apart by their flag: the similarity pass masks them out,
+    // dcdfill finds edge chunks by position and never seams towards a ghost, bobsweep gives the ring a shape of its own
+
+    for (int x = -1; x <= output->map_width; ++x)
+    {
+        *get_chunk(output, x, -1) = (pixelchunk){ { 0 }, CHUNK_GHOST, -1 };
+        *get_chunk(output, x, output->map_height) = (pixelchunk){ { 0 }, CHUNK_GHOST, -1 };
+    }
+
+    for (int y = 0; y < output->map_height; ++y)
+    {
+        *get_chunk(output, -1, y) = (pixelchunk){ { 0 }, CHUNK_GHOST, -1 };
+        *get_chunk(output, output->map_width, y) = (pixelchunk){ { 0 }, CHUNK_GHOST, -1 };
+    }
+    return output;
+}
+
+chunkmap* generate_chunkmap(image input, vectorize_options options)
+{
+    if (!input.pixels)
+    {
+        LOG_ERR("Invalid image input");
+        setError(ASSUMPTION_WRONG);
+        return NULL;
+    }
+    chunkmap* output = create_empty_chunkmap(input, options);
+
+    if (isBadError())
+    {
+        LOG_ERR("create_empty_chunkmap failed with code: %d", getLastError());
+        return NULL;
+    }
+    LOG_INFO("iterating chunkmap pixels with %d threads", options.thread_count);
+    chunkmap_band_stuff stuff = {
+        input, NULL, options, output, get_pixel_kernels(), NULL, NULL
+    };
+    return average_chunks(output, &stuff, average_chunk_rows);
+}
+
+struct chunk_accumulator
+{
+    chunkmap* map;
+    vectorize_options options;
+    const pixel_kernels* kernels;
+    uint32_t* sums; //r, g, b of every chunk in the chunk row being added up
+    int image_width;
+    int image_height;
+    int rows; //image rows added onto sums so far
+    int chunk_row; //the chunk row of the map sums belong to
+    palette* colours; //what indexed rows point into, NULL unless the decoder kept its palette
+    pixel* expanded; //one indexed row turned into colours
+    int band_rows; //chunk rows in a full band, all of them without options.band_sink
+    int64_t first_row; //where the map's first chunk row sits in the whole image
+};
+
+// An empty map for the chunk rows from accumulator->first_row on, as many as fit in a band
+chunkmap* create_accumulator_map(chunk_accumulator* accumulator)
+{
+    int chunk_size = accumulator->options.chunk_size;
+    int64_t first_pixel_row = accumulator->first_row * chunk_size;
+    int64_t height = (int64_t)accumulator->band_rows * chunk_size;
+
+    if (height > accumulator->image_height - first_pixel_row)
+        height = accumulator->image_height - first_pixel_row;
+
+    image dimensions = { accumulator->image_width, (int)height, accumulator->image_width, NULL };
+    chunkmap* map = create_empty_chunkmap(dimensions, accumulator->options);
+
+    if (isBadError())
+    {
+        LOG_ERR("create_empty_chunkmap failed with code: %d", getLastError());
+        return NULL;
+    }
+
+    if (accumulator->colours)
+        map->colour_indices = create_chunk_byte_grid(map, "chunk colour indices");
+
+    return map;
+}
+
+chunk_accumulator* create_chunk_accumulator(int width, int height, vectorize_options options)
+{
+    if (!can_chunk_image(width, height, options.chunk_size))
+        return NULL;
+
+    chunk_accumulator* output = calloc(1, sizeof(chunk_accumulator));
+    int map_width = (width + options.chunk_size - 1) / options.chunk_size;
+    int map_height = (height + options.chunk_size - 1) / options.chunk_size;
+    uint32_t* sums = calloc((size_t)map_width * 3, sizeof(uint32_t));
+
+    if (!output || !sums)
+    {
+        LOG_ERR("could not allocate chunk accumulator for %d chunks", map_width);
+        setError(ASSUMPTION_WRONG);
+        free(output);
+        free(sums);
+        return NULL;
+    }
+    *output = (chunk_accumulator){ NULL, options, get_pixel_kernels(), sums, width, height, 0, 0, NULL, NULL, map_height, 0 };
+    chunk_band_sink* sink = options.band_sink;
+
+    if (sink)
+    {
+        int64_t band_chunks = sink->band_chunks < INT32_MAX ? sink->band_chunks : INT32_MAX;
+        int64_t band_rows = band_chunks / (map_width + 2) - 2; //counting the ghost ring, like create_empty_chunkmap
+        output->band_rows = band_rows < 2 ? 2 : band_rows < map_height ? (int)band_rows : map_height; //a one row band has no inside
+        sink->map_width = map_width;
+        sink->map_height = map_height;
+
+        if (options.quantize_method == QUANTIZE_PALETTE)
         {
-            iterateImagePixels(x, y, input, options, output);
+            LOG_WARN("a palette needs every chunk of the image, the bands snap their channels instead");
+            output->options.quantize_method = QUANTIZE_CHANNELS;
         }
+        LOG_INFO("accumulating %d x %d chunks in bands of %d rows", map_width, map_height, output->band_rows);
+    }
+    output->map = create_accumulator_map(output);
+
+    if (!output->map)
+    {
+        free_chunk_accumulator(output);
+        return NULL;
+    }
+    return output;
+}
+
+void quantize_chunk_rows(void* userdata, int band_start, int band_end) {
+    for (int y = band_start; y < band_end; ++y)
+    {
+        quantize_chunk_row(userdata, y);
+    }
+}
+
+// The averages of a map as an image, what a palette gets made from when there is no full image
+image chunk_averages_image(chunkmap* map)
+{
+    image output = create_image(map->map_width, map->map_height);
+
+    if (isBadError())
+        return output;
+
+    for (int y = 0; y < map->map_height; ++y)
+    {
+        pixel* row = get_image_row(output, y);
+
+        for (int x = 0; x < map->map_width; ++x)
+            row[x] = get_chunk(map, x, y)->average_colour;
     }
     return output;
 }
 
-void free_pixelchunklist(pixelchunk_list* linkedlist) {
-    pixelchunk_list* current = linkedlist;
+// The decoder's palette stands in for quantizing: bigger chunks have their averages swapped for the nearest palette colour,
+// chunks of one pixel already are the colour of the index they kept
+chunkmap* snap_chunks_to_palette(chunkmap* output, palette* colours, vectorize_options options)
+{
+    chunkmap_band_stuff stuff = {
+        (image){ 0 }, NULL, options, output, get_pixel_kernels(), NULL, colours
+    };
 
-    while(current != NULL) {
-        pixelchunk_list* next = current->next;
-        free(current); //the reference held to the pixel will be cleaned up
-        current = next;
+    if (options.chunk_size > 1)
+    {
+        LOG_INFO("snapping decoded chunk averages to %d palette colours with %d threads", colours->count, options.thread_count);
+        run_in_bands(options.thread_count, output->map_height, quantize_chunk_rows, &stuff);
     }
+    finish_chunk_quantizer(&stuff);
+    return output;
 }
 
-void free_chunkmap(chunkmap* map_p)
+// Quantizes the chunks of a finished map like options.quantize_chunks, colours is the decoder's palette or NULL.
+// Takes colours over, and frees output when it fails.
+chunkmap* quantize_accumulated_chunks(chunkmap* output, palette* colours, vectorize_options options)
 {
-    if (!map_p) {
+    if (colours)
+        return snap_chunks_to_palette(output, colours, options);
+
+    image averages = { 0 };
+
+    if (options.quantize_method == QUANTIZE_PALETTE)
+    {
+        averages = chunk_averages_image(output);
+
+        if (isBadError())
+        {
+            free_chunkmap(output);
+            return NULL;
+        }
+    }
+    LOG_INFO("quantizing decoded chunk averages with %d threads", options.thread_count);
+    chunkmap_band_stuff stuff = {
+        averages, NULL, options, output, get_pixel_kernels(), NULL, NULL
+    };
+    quantize_table channel_table;
+    prepare_chunk_quantizer(&stuff, &channel_table);
+
+    if (!isBadError())
+    {
+        run_in_bands(options.thread_count, output->map_height, quantize_chunk_rows, &stuff);
+        finish_chunk_quantizer(&stuff);
+    }
+
+    if (averages.pixels)
+        free_image_contents(averages);
+
+    if (isBadError())
+    {
+        LOG_ERR("could not quantize decoded chunks: %d", getLastError());
+        free_palette(stuff.colours);
+        free_chunkmap(output);
+        return NULL;
+    }
+    return output;
+}
+
+// Quantizes the band that just filled up, hands it to the sink and starts on the next band
+void send_accumulator_band(chunk_accumulator* accumulator)
+{
+    chunk_band_sink* sink = accumulator->options.band_sink;
+    chunkmap* band = accumulator->map;
+    int band_height = band->map_height;
+    palette* colours = NULL;
+    accumulator->map = NULL;
+
+    if (accumulator->colours)
+    {
+        colours = malloc(sizeof(palette)); //every band gets its own copy of the decoder's palette
+
+        if (!colours)
+        {
+            LOG_ERR("could not copy the palette for a band");
+            setError(ASSUMPTION_WRONG);
+            free_chunkmap(band);
+            return;
+        }
+        *colours = *accumulator->colours;
+    }
+    band = quantize_accumulated_chunks(band, colours, accumulator->options);
+
+    if (!band)
+        return;
+
+    LOG_INFO("handing over chunk rows %lld to %lld", (long long)accumulator->first_row, (long long)accumulator->first_row + band_height);
+    sink->take_band(sink->userdata, band, accumulator->first_row);
+    accumulator->first_row += band_height;
+    accumulator->chunk_row = 0;
+
+    if (isBadError() || accumulator->first_row == sink->map_height)
         return;
+
+    accumulator->map = create_accumulator_map(accumulator);
+}
+
+// Turns the sums into the averages of one row of chunks, and starts on the next
+void finish_chunk_row(chunk_accumulator* accumulator)
+{
+    chunkmap* map = accumulator->map;
+
+    for (int x = 0; x < map->map_width; ++x)
+    {
+        int node_width, node_height;
+        pixelchunk* chunk = prepare_chunk(x, accumulator->chunk_row, map->input, accumulator->options, map, &node_width, &node_height);
+        uint32_t* sums = &accumulator->sums[x * 3];
+        uint32_t count = (uint32_t)(node_width * accumulator->rows);
+
+        chunk->average_colour = (pixel){
+            (byte)(sums[0] / count),
+            (byte)(sums[1] / count),
+            (byte)(sums[2] / count)
+        };
     }
+    memset(accumulator->sums, 0, (size_t)map->map_width * 3 * sizeof(uint32_t));
+    accumulator->rows = 0;
+    ++accumulator->chunk_row;
+
+    // a full band goes to the sink right away, the last one waits for finish_chunk_accumulator
+    chunk_band_sink* sink = accumulator->options.band_sink;
 
-    else {
-        for (int x = 0; x < map_p->map_width; ++x)
+    if (sink && accumulator->chunk_row == map->map_height && accumulator->first_row + map->map_height < sink->map_height)
+        send_accumulator_band(accumulator);
+}
+
+void accumulate_pixel_row(chunk_accumulator* accumulator, const pixel* row)
+{
+    chunkmap* map = accumulator->map;
+    int chunk_size = accumulator->options.chunk_size;
+
+    if (!map || accumulator->chunk_row >= map->map_height)
+    {
+        LOG_ERR("more rows than the %d of the image", accumulator->image_height);
+        setError(OVERFLOW_ERROR);
+        return;
+    }
+
+    for (int x = 0; x < map->map_width; ++x)
+    {
+        const pixel* pixels = &row[x * chunk_size];
+        uint32_t* sums = &accumulator->sums[x * 3];
+        int node_width = accumulator->image_width - x * chunk_size;
+
+        if (node_width > chunk_size)
+            node_width = chunk_size;
+
+        // same split as iterateImagePixels, the sums are exact either way
+        if (node_width >= 16)
+        {
+            accumulator->kernels->sum_pixels(pixels, node_width, sums);
+            continue;
+        }
+
+        for (int i = 0; i < node_width; ++i)
         {
-            pixelchunk* current = map_p->groups_array_2d[x];
-            free(current);
+            sums[0] += pixels[i].r;
+            sums[1] += pixels[i].g;
+            sums[2] += pixels[i].b;
         }
     }
+    ++accumulator->rows;
+
+    if (accumulator->rows == chunk_size || accumulator->chunk_row * chunk_size + accumulator->rows == map->input.height)
+        finish_chunk_row(accumulator);
+}
 
-    if(map_p->groups_array_2d) {
-        free(map_p->groups_array_2d);
+void use_accumulator_palette(chunk_accumulator* accumulator, palette* colours)
+{
+    chunkmap* map = accumulator->map;
+    accumulator->colours = colours;
+    accumulator->expanded = calloc(accumulator->image_width, sizeof(pixel));
+
+    if (!accumulator->expanded)
+    {
+        LOG_ERR("could not allocate a row of %d pixels", accumulator->image_width);
+        setError(ASSUMPTION_WRONG);
+        return;
     }
-    
-    if(map_p->shape_list) {
-        chunkshape* current = map_p->shape_list;
-        chunkshape* next;
+    map->colour_indices = create_chunk_byte_grid(map, "chunk colour indices");
+}
+
+void accumulate_indexed_row(chunk_accumulator* accumulator, const byte* indices)
+{
+    chunkmap* map = accumulator->map;
+    const pixel* colours = accumulator->colours->colours;
+
+    // a chunk of one pixel is that pixel's index
+    if (accumulator->options.chunk_size == 1 && map && accumulator->chunk_row < map->map_height)
+        memcpy(&map->colour_indices[accumulator->chunk_row * map->chunk_stride], indices, map->map_width);
+
+    for (int x = 0; x < accumulator->image_width; ++x)
+        accumulator->expanded[x] = colours[indices[x]];
+
+    accumulate_pixel_row(accumulator, accumulator->expanded);
+}
+
+chunkmap* finish_chunk_accumulator(chunk_accumulator* accumulator)
+{
+    chunkmap* output = accumulator->map;
+
+    if (!output)
+    {
+        free_chunk_accumulator(accumulator); //a band went wrong, what went wrong with it is logged already
+        return NULL;
+    }
+
+    if (accumulator->chunk_row != output->map_height)
+    {
+        LOG_ERR("image ended after %lld chunk rows", (long long)accumulator->first_row + accumulator->chunk_row);
+        setError(READ_FILE_ERROR);
+        free_chunk_accumulator(accumulator);
+        return NULL;
+    }
+
+    if (accumulator->options.band_sink)
+    {
+        send_accumulator_band(accumulator);
+        free_chunk_accumulator(accumulator);
+        return NULL;
+    }
+    vectorize_options options = accumulator->options;
+    palette* colours = accumulator->colours;
+    accumulator->map = NULL; //the caller owns it now
+    accumulator->colours = NULL; //the map gets a copy of it
+    free_chunk_accumulator(accumulator);
+    return quantize_accumulated_chunks(output, colours, options);
+}
+
+void free_chunk_accumulator(chunk_accumulator* accumulator)
+{
+    if (!accumulator)
+        return;
+
+    free_chunkmap(accumulator->map);
+    free_palette(accumulator->colours);
+    free(accumulator->expanded);
+    free(accumulator->sums);
+    free(accumulator);
+}
+
+chunkmap* generate_chunkmap_from_pixels(const uint8_t* pixels, int width, int height, size_t stride, int channels, vectorize_options options)
+{
+    if (!pixels)
+    {
+        LOG_ERR("pixels not given");
+        setError(NULL_ARGUMENT_ERROR);
+        return NULL;
+    }
+
+    if ((channels != 3 && channels != 4) || width < 1 || height < 1 || stride < (size_t)width * channels)
+    {
+        LOG_ERR("can not read %d x %d pixels of %d channels with a stride of %zu bytes", width, height, channels, stride);
+        setError(BAD_ARGUMENT_ERROR);
+        return NULL;
+    }
+    chunk_accumulator* accumulator = create_chunk_accumulator(width, height, options);
+
+    if (isBadError())
+        return NULL;
+
+    pixel* packed = NULL;
+
+    if (channels == 4)
+    {
+        packed = malloc((size_t)width * sizeof(pixel));
+
+        if (!packed)
+        {
+            LOG_ERR("could not allocate a row of %d pixels", width);
+            setError(ASSUMPTION_WRONG);
+            free_chunk_accumulator(accumulator);
+            return NULL;
+        }
+    }
+    LOG_INFO("averaging %d x %d pixels of %d channels into chunks of %d", width, height, channels, options.chunk_size);
+
+    for (int y = 0; y < height && !isBadError(); ++y)
+    {
+        const uint8_t* row = &pixels[(size_t)y * stride];
+
+        if (!packed)
+        {
+            accumulate_pixel_row(accumulator, (const pixel*)row);
+            continue;
+        }
+
+        for (int x = 0; x < width; ++x)
+            packed[x] = (pixel){ row[x * 4], row[x * 4 + 1], row[x * 4 + 2] };
+
+        accumulate_pixel_row(accumulator, packed);
+    }
+    free(packed);
+
+    if (isBadError())
+    {
+        free_chunk_accumulator(accumulator);
+        return NULL;
+    }
+    return finish_chunk_accumulator(accumulator);
+}
+
+summed_area_table* create_summed_area_table(image input)
+{
+    if (!input.pixels || input.width < 1 || input.height < 1)
+    {
+        LOG_ERR("Invalid dimensions or bad image");
+        setError(ASSUMPTION_WRONG);
+        return NULL;
+    }
+    LOG_INFO("building summed area table for %d x %d image", input.width, input.height);
+    summed_area_table* output = calloc(1, sizeof(summed_area_table));
+
+    if (!output)
+    {
+        LOG_ERR("could not allocate summed area table");
+        setError(ASSUMPTION_WRONG);
+        return NULL;
+    }
+    output->width = input.width + 1;
+    output->height = input.height + 1;
+    output->sums = calloc((size_t)output->width * output->height * 3, sizeof(uint32_t)); // first row and column stay zero
 
-        //free all shapes
-        while (current)
-        {            
-            free_pixelchunklist(current->boundaries);
-            free_pixelchunklist(current->chunks);
-            next = current->next;
-            free(current);
-            current = next;
+    if (!output->sums)
+    {
+        LOG_ERR("could not allocate sums for %d x %d summed area table", output->width, output->height);
+        setError(ASSUMPTION_WRONG);
+        free(output);
+        return NULL;
+    }
+
+    for (int y = 0; y < input.height; ++y)
+    {
+        pixel* row = get_image_row(input, y);
+        uint32_t* above = &output->sums[(size_t)y * output->width * 3];
+        uint32_t* current = above + (size_t)output->width * 3;
+        uint32_t running_r = 0, running_g = 0, running_b = 0;
+
+        for (int x = 0; x < input.width; ++x)
+        {
+            running_r += row[x].r;
+            running_g += row[x].g;
+            running_b += row[x].b;
+            current[(x + 1) * 3] = above[(x + 1) * 3] + running_r;
+            current[(x + 1) * 3 + 1] = above[(x + 1) * 3 + 1] + running_g;
+            current[(x + 1) * 3 + 2] = above[(x + 1) * 3 + 2] + running_b;
         }
     }
+    return output;
+}
 
-    if(map_p) {
-        free(map_p);
+void free_summed_area_table(summed_area_table* table)
+{
+    if (!table)
+        return;
+
+    free(table->sums);
+    free(table);
+}
+
+chunkmap* generate_chunkmap_from_table(image input, summed_area_table* table, vectorize_options options)
+{
+    if (!table || table->width != input.width + 1 || table->height != input.height + 1)
+    {
+        LOG_ERR("summed area table does not belong to the image");
+        setError(BAD_ARGUMENT_ERROR);
+        return NULL;
     }
+    chunkmap* output = create_empty_chunkmap(input, options);
+
+    if (isBadError())
+    {
+        LOG_ERR("create_empty_chunkmap failed with code: %d", getLastError());
+        return NULL;
+    }
+    LOG_INFO("averaging chunks from summed area table with %d threads", options.thread_count);
+    chunkmap_band_stuff stuff = {
+        input, table, options, output, get_pixel_kernels(), NULL, NULL
+    };
+    return average_chunks(output, &stuff, average_chunk_rows_from_table);
+}
+
+void free_chunkmap(chunkmap* map_p)
+{
+    if (!map_p) {
+        return;
+    }
+
+    if(map_p->chunks) {
+        free(map_p->chunks - map_p->chunk_stride - 1); //back to the top left ghost chunk
+    }
+
+    if(map_p->similar_neighbours) {
+        free(map_p->similar_neighbours - map_p->chunk_stride - 1);
+    }
+
+    if(map_p->colour_indices) {
+        free(map_p->colour_indices - map_p->chunk_stride - 1);
+    }
+    free_arena(map_p->allocator); //all shapes and their index arrays
+    free(map_p);
     LOG_INFO("freed chunkmap");
 }
 
-int count_list(pixelchunk_list* first)
+typedef struct
 {
-    int count = 0;
-    pixelchunk_list* iter = first;
-    for (; iter; iter = iter->next)
+    chunkmap* map;
+    int limit; //squared distance
+    const pixel_kernels* kernels;
+    similarity_matrix* matrix; //which palette colours are similar, only when the map has colour indices
+} similarity_band_stuff;
+
+void find_similar_neighbour_rows(void* userdata, int band_start, int band_end)
+{
+    similarity_band_stuff* stuff = userdata;
+    chunkmap* map = stuff->map;
+    int width = map->map_width;
+
+    for (int y = band_start; y < band_end; ++y)
     {
-        count++;
+        pixelchunk* row = get_chunk(map, 0, y);
+        byte* masks = &map->similar_neighbours[y * map->chunk_stride];
+        memset(masks, 0, width);
+
+        // one neighbour at a time across the whole row
+        if (stuff->matrix)
+        {
+            byte* indices = &map->colour_indices[y * map->chunk_stride];
+
+            for (int k = 0; k < NEIGHBOUR_COUNT; ++k)
+                stuff->kernels->mark_similar_indices(indices, indices + map->neighbour_offsets[k], width, stuff->matrix, (byte)(1 << k), masks);
+        }
+        else
+        {
+            for (int k = 0; k < NEIGHBOUR_COUNT; ++k)
+                stuff->kernels->mark_similar_chunks(row, row + map->neighbour_offsets[k], width, stuff->limit, (byte)(1 << k), masks);
+        }
+
+        // neither way looks at flags, ghosts are never similar
+        int edge_row = y == 0 || y == map->map_height - 1;
+        int step = edge_row || width == 1 ? 1 : width - 1; //all of an edge row, otherwise just both ends
+
+        for (int x = 0; x < width; x += step)
+        {
+            for (int k = 0; k < NEIGHBOUR_COUNT; ++k)
+            {
+                if (row[x + map->neighbour_offsets[k]].flags & CHUNK_GHOST)
+                    masks[x] &= (byte)~(1 << k);
+            }
+        }
     }
-    return count;
 }
 
-int count_shapes(chunkshape* first)
+void find_similar_neighbours(chunkmap* map, float threshold, int thread_count)
 {
-    int count = 0;
-    for (; first; first = first->next)
-        ++count;
-    return count;
+    if (!map->similar_neighbours)
+    {
+        map->similar_neighbours = create_chunk_byte_grid(map, "similar neighbour masks"); //the ghost ring stays 0, similar to nothing
+
+        if (!map->similar_neighbours)
+            return;
+    }
+    similarity_band_stuff stuff = { map, similarity_limit(threshold), get_pixel_kernels(), NULL };
+
+    if (map->palette)
+    {
+        // a palette has few enough colours to compare every pair up front, then the rows only look up indices
+        stuff.matrix = malloc(sizeof(similarity_matrix));
+
+        if (!stuff.matrix)
+        {
+            LOG_ERR("could not allocate palette similarity matrix");
+            setError(ASSUMPTION_WRONG);
+            return;
+        }
+        fill_similarity_matrix(map->palette, stuff.limit, stuff.matrix);
+    }
+    LOG_INFO("finding similar neighbours with threshold %.1f (squared %d)%s", threshold, stuff.limit, stuff.matrix ? " by palette index" : "");
+    run_in_bands(thread_count, map->map_height, find_similar_neighbour_rows, &stuff);
+    free(stuff.matrix);
+}
+
+void set_chunk_palette(chunkmap* map, indexed_image indexed)
+{
+    if (!indexed.indices || !indexed.palette)
+    {
+        LOG_ERR("indexed image has no indices or palette");
+        setError(NULL_ARGUMENT_ERROR);
+        return;
+    }
+
+    if (indexed.width != map->map_width || indexed.height != map->map_height)
+    {
+        LOG_ERR("indexed image is %dx%d but the chunkmap is %dx%d", indexed.width, indexed.height, map->map_width, map->map_height);
+        setError(ARRAY_DIFF_SIZE_ERROR);
+        return;
+    }
+
+    if (!map->colour_indices)
+    {
+        map->colour_indices = create_chunk_byte_grid(map, "chunk colour indices");
+
+        if (!map->colour_indices)
+            return;
+    }
+
+    for (int y = 0; y < map->map_height; ++y)
+    {
+        memcpy(&map->colour_indices[y * map->chunk_stride], &indexed.indices[(size_t)y * indexed.stride], map->map_width);
+    }
+    map->palette = arena_alloc(map->allocator, sizeof(palette));
+
+    if (!map->palette)
+    {
+        LOG_ERR("could not copy the palette into the chunkmap");
+        setError(ASSUMPTION_WRONG);
+        return;
+    }
+    *map->palette = *indexed.palette;
 }
 
+pixelchunk* get_chunk(chunkmap* map, int x, int y)
+{
+    return &map->chunks[x + y * map->chunk_stride];
+}
 
-vector2 create_vector_between_chunks(pixelchunk* initial, pixelchunk* final) {
-    int x_diff = final->location.x - initial->location.x;
-    int y_diff = final->location.y - initial->location.y;
-    vector2 diff = { x_diff, y_diff };
-    return diff;
+pixelchunk* get_chunk_at_index(chunkmap* map, int32_t index)
+{
+    return get_chunk(map, index % map->map_width, index / map->map_width);
 }
 
-float calculate_angle_between(pixelchunk* eligible, pixelchunk* subject, pixelchunk* previous) {
-    int eligible_x_diff = eligible->location.x - subject->location.x;
-    int eligible_y_diff = eligible->location.y - subject->location.y;
-    vector2 subject_to_eligible = { eligible_x_diff, eligible_y_diff };
-    vector2 previous_to_subject = create_vector_between_chunks(previous, subject);
-    return vec_angle_between(previous_to_subject, subject_to_eligible);
-}
\ No newline at end of file
+vector2 get_border_location(chunkmap* map, int32_t index)
+{
+    int x = index % map->map_width;
+    int y = index / map->map_width;
+    int seam = get_chunk(map, x, y)->flags & CHUNK_SEAM_MASK;
+
+    if (!seam)
+        return (vector2){ (float)x, (float)y };
+
+    return (vector2){ x + NEIGHBOUR_X[seam - 1] * 0.5f, y + NEIGHBOUR_Y[seam - 1] * 0.5f };
+}
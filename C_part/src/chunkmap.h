@@ -2,64 +2,136 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "image.h"
 #include "utility/vec.h"
+#include "utility/arena.h"
+#include "palette.h"
 
-struct chunkshape; //allows circular reference
+enum chunk_consts {
+    NEIGHBOUR_COUNT = 8,
+    CHUNK_SEAM_MASK = 0x0f, //0 when the chunk's border sits on the chunk itself, otherwise 1 + the neighbour it leans towards
+    CHUNK_GHOST = 0x10, //the padding ring around the grid, never part of a shape
+    ALL_NEIGHBOURS = 0xff
+};
 
+// Neighbours in scan order: the row above, left and right, then the row below
+extern const int NEIGHBOUR_X[NEIGHBOUR_COUNT];
+extern const int NEIGHBOUR_Y[NEIGHBOUR_COUNT];
+
+// Where a chunk is follows from its index in the grid, so a chunk only holds what changes per chunk
 typedef struct 
 {
     pixel average_colour;
-    pixel** pixels_array_2d;
-    coordinate location;
-    vector2 border_location;
-    struct chunkshape* shape_chunk_in;
-    struct chunkshape* boundary_chunk_in;
+    byte flags;
+    int32_t shape_index; //index into the map's shape list, -1 until the chunk is filled
 } pixelchunk;
 
-typedef struct pixelchunk_list
-{    
-    pixelchunk* chunk_p;
-    struct pixelchunk_list* firstitem;
-    struct pixelchunk_list* next;
-} pixelchunk_list;
-
+// A shape's chunks are stored as a range of the map's index arrays, every index is x + y * map_width
 typedef struct chunkshape {
     bool filled;
     int chunks_amount; //chunks_amount also includes boundaries_length
-    pixelchunk_list* chunks;
+    int chunks_offset; //first of the shape's entries in chunk_indices
     int boundaries_length;
-    pixelchunk_list* boundaries;
+    int boundaries_offset; //first of the shape's entries in boundary_indices, in drawing order once sorted
     int pathcount;
     pixel colour;
-    struct chunkshape* previous;
-    struct chunkshape* next;
 } chunkshape;
 
+// The chunks sit in one row-major grid with a ghost chunk all the way around it,
+// so a chunk's 8 neighbours are always at the same offsets and never need bounds checks
 typedef struct 
 {
-    pixelchunk** groups_array_2d;
-    chunkshape* shape_list;
+    pixelchunk* chunks; //chunk (x, y) is chunks[x + y * chunk_stride], x and y go from -1 to map_width and map_height
+    int chunk_stride; //map_width + 2
+    int neighbour_offsets[NEIGHBOUR_COUNT]; //grid offsets of NEIGHBOUR_X and NEIGHBOUR_Y
+    byte* similar_neighbours; //laid out like chunks, bit k is set when neighbour k is a real chunk within the colour threshold
+    byte* colour_indices; //laid out like chunks, the palette index of every chunk's colour, NULL unless the colours came from a palette
+    palette* palette; //what colour_indices point into, lives in the map's arena
+    chunkshape* shape_list; //shape_count shapes next to each other
     int shape_count;
+    int32_t* chunk_indices; //every chunk, grouped by shape
+    int32_t* boundary_indices; //every boundary chunk, grouped by shape
     int map_width; 
     int map_height;
     image input;
+    arena* allocator; //owns the shapes and their index arrays, they all go away with the map
 } chunkmap;
 
+// Where a chunk accumulator hands its chunks over a band of rows at a time, instead of building one map of the whole image
+typedef struct
+{
+    int64_t band_chunks; //most chunks a band holds counting its ghost ring, a band is at least two rows of chunks however wide they are
+    int64_t map_width; //chunks across the whole image, filled in by the accumulator
+    int64_t map_height;
+    // Gets every band once it is quantized, in order from the top. first_row is where the band's first row sits in the whole map.
+    // The band is the sink's to free.
+    void (*take_band)(void* userdata, chunkmap* band, int64_t first_row);
+    void* userdata;
+} chunk_band_sink;
+
 typedef struct
 {
     char* file_path;
     int chunk_size;
     float shape_colour_threshhold;
     int num_colours;
+    int thread_count; //worker threads used by the parallel stages, less than 2 runs everything on the calling thread
+    int quantize_method; //a quantize_method from simplify.h, channel snapping unless set
+    int kmeans_iterations; //rounds of k-means over the median cut palette of QUANTIZE_PALETTE
+    bool quantize_chunks; //quantize the chunk averages while the chunkmap is built, instead of every pixel of the image first
+    bool decode_to_chunks; //average the image into the chunkmap while it is decoded, so the full image is never held
+    chunk_band_sink* band_sink; //NULL decodes into one map, otherwise the chunks go to the sink a band at a time
 } vectorize_options;
 
+// Per channel sums of every pixel above and to the left of each position. Row 0 and column 0 are zero.
+// The sums wrap around past 2^32, which cancels out when taking the difference over one chunk.
+typedef struct
+{
+    int width; //image width + 1
+    int height; //image height + 1
+    uint32_t* sums; //r, g, b interleaved
+} summed_area_table;
+
+// With options.quantize_chunks the chunk colours come out quantized and the image is only read,
+// a palette also gives the map its colour indices
 chunkmap* generate_chunkmap(image inputimage_p, vectorize_options options);
 void free_chunkmap(chunkmap* map_p);
 
-int count_list(pixelchunk_list* first);
-int count_shapes(chunkshape* first);
+// Adds up the rows of an image as a decoder hands them over, and finishes a row of chunks every chunk_size rows.
+// Only one row of sums is kept, the image rows can be thrown away as soon as they are added.
+typedef struct chunk_accumulator chunk_accumulator;
+
+chunk_accumulator* create_chunk_accumulator(int width, int height, vectorize_options options);
+void accumulate_pixel_row(chunk_accumulator* accumulator, const pixel* row);
+// For a decoder that hands over palette indices: the chunks get snapped to colours instead of quantized.
+// With one pixel per chunk every chunk just keeps its index. The accumulator takes colours over.
+void use_accumulator_palette(chunk_accumulator* accumulator, palette* colours);
+void accumulate_indexed_row(chunk_accumulator* accumulator, const byte* indices);
+// Quantizes the chunks like options.quantize_chunks, and hands over the map. A palette is made from the chunk averages.
+// The map's input has the image's dimensions but no pixels. Frees the accumulator either way.
+// With options.band_sink every band before the last went to the sink already, the last one goes too and this gives back NULL.
+// Bands are quantized on their own, so they can't make a palette and get their channels snapped instead.
+chunkmap* finish_chunk_accumulator(chunk_accumulator* accumulator);
+void free_chunk_accumulator(chunk_accumulator* accumulator);
+
+// A chunkmap straight from decoded rgb or rgba rows the caller owns, stride is in bytes.
+// Rgb rows are read where they are, rgba rows get the alpha dropped one row at a time. The pixels are never written.
+chunkmap* generate_chunkmap_from_pixels(const uint8_t* pixels, int width, int height, size_t stride, int channels, vectorize_options options);
+
+summed_area_table* create_summed_area_table(image input);
+void free_summed_area_table(summed_area_table* table);
+chunkmap* generate_chunkmap_from_table(image input, summed_area_table* table, vectorize_options options);
+
+// Hands the map the palette index of every chunk, so find_similar_neighbours compares indices instead of colours.
+// Only a map of one pixel per chunk lines up with an indexed image, the map keeps its own copy of both.
+void set_chunk_palette(chunkmap* map, indexed_image indexed);
+
+// Compares every chunk with its neighbours once, the fill and labeling stages read similar_neighbours instead of comparing colours
+void find_similar_neighbours(chunkmap* map, float threshold, int thread_count);
 
+pixelchunk* get_chunk(chunkmap* map, int x, int y);
+pixelchunk* get_chunk_at_index(chunkmap* map, int32_t index);
 
-vector2 create_vector_between_chunks(pixelchunk* initial, pixelchunk* final);
-float calculate_angle_between(pixelchunk* eligible, pixelchunk* subject, pixelchunk* previous);
\ No newline at end of file
+// The point a boundary chunk's path goes through, half a chunk over towards its seam
+vector2 get_border_location(chunkmap* map, int32_t index);
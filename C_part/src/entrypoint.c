@@ -1,11 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 #include "entrypoint.h"
 #include "nsvg/usage.h"
+#include "nsvg/bands.h"
 #include "utility/logger.h"
 #include "utility/error.h"
+#include "utility/workers.h"
 #include "imagefile/pngfile.h"
+#include "imagefile/loader.h"
 #include "imagefile/svg.h"
 #include "simplify.h"
 #include "string.h"
@@ -15,17 +19,50 @@ const char *format2_p = "jpeg";
 const int DEFAULT_CHUNKSIZE = 1;
 const int DEFAULT_THRESHOLD = 1;
 const int DEFAULT_COLOURS = 256;
+const int DEFAULT_KMEANS_ITERATIONS = 4;
 
 typedef NSVGimage* (*algorithm)(image, vectorize_options);
+typedef NSVGimage* (*chunkmap_algorithm)(chunkmap*, vectorize_options);
 typedef void (*algorithm_debug)(image, vectorize_options, char*,char*);
 algorithm target_algorithm = dcdfill_for_nsvg;
+chunkmap_algorithm target_chunkmap_algorithm = dcdfill_chunkmap_for_nsvg;
+shape_finder target_shape_finder = dcdfill_find_shapes;
+int target_quantize_method = QUANTIZE_CHANNELS;
+bool target_quantize_chunks = false;
+bool target_decode_to_chunks = false;
+bool target_decode_to_bands = false;
 
-int execute_program(vectorize_options options) {
-	image img = convert_png_to_image(options.file_path);
+// Runs the chosen algorithm on a chunkmap that is already built and quantized, and writes the svg
+int vectorize_chunkmap(chunkmap* map, vectorize_options options) {
+	if (isBadError())
+	{
+		LOG_ERR("building the chunkmap failed with: %d", getLastError());
+		return getAndResetErrorCode();
+	}
+
+	NSVGimage* nsvg = target_chunkmap_algorithm(map, options);
+	int code = getLastError();
+
+	if(isBadError() || nsvg == NULL) {
+		free_nsvg(nsvg);
+		LOG_ERR("vectorize_image failed with code: %d", code);
+		return getAndResetErrorCode();
+	}
+	bool result = write_svg_file(nsvg);
+	code = getLastError();
+	free_nsvg(nsvg);
 
+	if(result == false || isBadError()) {
+		LOG_ERR("write_svg_file failed with code: %d", code);
+	}
+	return getAndResetErrorCode();
+}
+
+// Runs the chosen algorithm on a decoded image, and writes the svg
+int vectorize_decoded_image(image img, vectorize_options options) {
 	if (isBadError())
 	{
-		LOG_ERR("convert_png_to_image failed with: %d", getLastError());
+		LOG_ERR("decoding the image failed with: %d", getLastError());
 		return getAndResetErrorCode();
 	}
 
@@ -53,6 +90,54 @@ int execute_program(vectorize_options options) {
 	return getAndResetErrorCode();
 }
 
+int execute_program(vectorize_options options) {
+	// an image too big for one chunkmap goes through a band at a time, the svg is written as the bands are done
+	if (target_decode_to_bands)
+	{
+		if (!vectorize_file_in_bands(options, target_shape_finder, DEFAULT_BAND_CHUNKS))
+			LOG_ERR("vectorize_file_in_bands failed with code: %d", getLastError());
+
+		return getAndResetErrorCode();
+	}
+
+	// decoding to chunks never holds the full image, the chunkmap is built while the file is decoded
+	decoded_image_file decoded = decode_image_file(&options); //a jpeg may have done some of the chunking already
+
+	if (decoded.map)
+		return vectorize_chunkmap(decoded.map, options);
+
+	return vectorize_decoded_image(decoded.img, options);
+}
+
+// Clamps the user's settings into options, file_path is NULL for input that is already in memory
+vectorize_options create_options(char* file_path, int chunk_size, float threshold, int num_colours) {
+	if (chunk_size < 1)
+		chunk_size = DEFAULT_CHUNKSIZE;
+
+	if (threshold < 0.f)
+		threshold = 1;
+
+	if (num_colours > DEFAULT_COLOURS)
+		num_colours = DEFAULT_COLOURS;
+
+	if (num_colours < 1)
+		num_colours = 1;
+
+	vectorize_options options = {
+		file_path,
+		chunk_size,
+		threshold,
+		num_colours,
+		get_core_count(),
+		target_quantize_method,
+		DEFAULT_KMEANS_ITERATIONS,
+		target_quantize_chunks || target_decode_to_chunks, //decoding to chunks can only quantize the chunks
+		target_decode_to_chunks,
+		NULL //execute_program hands vectorize_file_in_bands its own sink
+	};
+	return options;
+}
+
 //PUBLIC FACING
 int entrypoint(int argc, char* argv[]) {
 	clear_logfile();
@@ -87,28 +172,16 @@ int entrypoint(int argc, char* argv[]) {
 	if (argc > 3)
 		chunk_size = atoi(argv[3]);
 
-	if (chunk_size < 1)
-		chunk_size = DEFAULT_CHUNKSIZE;
-
 	float threshold = DEFAULT_THRESHOLD;
 
 	if (argc > 4)
 		threshold = (float)atof(argv[4]);	
-		
-	if (threshold < 0.f)
-		threshold = 1;
 
 	int num_colours = DEFAULT_COLOURS;
 
 	if(argc > 5)
 		num_colours = (int)atoi(argv[5]);
 
-	if (num_colours > DEFAULT_COLOURS)
-		num_colours = DEFAULT_COLOURS;
-
-	if (num_colours < 1)
-		num_colours = 1;
-
 	// Halt execution if either path is bad
 	if (input_file_path == NULL || output_file_p == NULL)
 	{
@@ -116,16 +189,64 @@ int entrypoint(int argc, char* argv[]) {
 		return SUCCESS_CODE;
 	}
 
-	LOG_INFO("Vectorizing with input: '%s' output: '%s' chunk size: '%d' threshold: '%f', colours: %d", input_file_path, output_file_p, chunk_size, threshold, num_colours);
+	vectorize_options options = create_options(input_file_path, chunk_size, threshold, num_colours);
+	LOG_INFO("Vectorizing with input: '%s' output: '%s' chunk size: '%d' threshold: '%f', colours: %d", input_file_path, output_file_p, options.chunk_size, options.shape_colour_threshhold, options.num_colours);
+	return execute_program(options);
+}
+
+//PUBLIC FACING
+int vectorize_png_buffer(const uint8_t* data, size_t length, int chunk_size, float threshold, int num_colours) {
+	clear_logfile();
+	vectorize_options options = create_options(NULL, chunk_size, threshold, num_colours);
+	LOG_INFO("Vectorizing %zu byte png buffer with chunk size: '%d' threshold: '%f', colours: %d", length, options.chunk_size, options.shape_colour_threshhold, options.num_colours);
 
-	vectorize_options options = {
-		input_file_path,
-		chunk_size,
-		threshold,
-		num_colours
-	};
+	decoded_image_file decoded = decode_image_buffer(data, length, &options); //the same palette and chunking choices as a file
 
-	return execute_program(options);
+	if (decoded.map)
+		return vectorize_chunkmap(decoded.map, options);
+
+	return vectorize_decoded_image(decoded.img, options);
+}
+
+//PUBLIC FACING
+int vectorize_pixels(const uint8_t* pixels, int width, int height, size_t stride, int channels, int chunk_size, float threshold, int num_colours) {
+	clear_logfile();
+	vectorize_options options = create_options(NULL, chunk_size, threshold, num_colours);
+	options.quantize_chunks = true; //the caller's pixels are only ever read
+	LOG_INFO("Vectorizing %d x %d pixels with chunk size: '%d' threshold: '%f', colours: %d", width, height, options.chunk_size, options.shape_colour_threshhold, options.num_colours);
+	return vectorize_chunkmap(generate_chunkmap_from_pixels(pixels, width, height, stride, channels, options), options);
+}
+
+//PUBLIC FACING
+png_stream* start_png_stream(int chunk_size, float threshold, int num_colours) {
+	clear_logfile();
+	vectorize_options options = create_options(NULL, chunk_size, threshold, num_colours);
+	options.quantize_chunks = true; //rows are gone as soon as they are averaged
+	options.decode_to_chunks = true;
+	LOG_INFO("Starting png stream with chunk size: '%d' threshold: '%f', colours: %d", options.chunk_size, options.shape_colour_threshhold, options.num_colours);
+	png_stream* stream = create_png_stream(options);
+	getAndResetErrorCode();
+	return stream;
+}
+
+//PUBLIC FACING
+int push_png_stream(png_stream* stream, const uint8_t* data, size_t length) {
+	if (!stream) {
+		LOG_ERR("png stream not given");
+		return NULL_ARGUMENT_ERROR;
+	}
+	push_png_bytes(stream, data, length);
+	return getAndResetErrorCode();
+}
+
+//PUBLIC FACING
+int finish_png_stream_to_svg(png_stream* stream) {
+	if (!stream) {
+		LOG_ERR("png stream not given");
+		return NULL_ARGUMENT_ERROR;
+	}
+	vectorize_options options = get_png_stream_options(stream);
+	return vectorize_chunkmap(finish_png_stream(stream), options);
 }
 
 //PUBLIC FACING
@@ -133,11 +254,15 @@ int set_algorithm(char* argv)
 {
 	if(strcmp(argv, "dcdfill") == 0) {
 		target_algorithm = dcdfill_for_nsvg;
+		target_chunkmap_algorithm = dcdfill_chunkmap_for_nsvg;
+		target_shape_finder = dcdfill_find_shapes;
 		LOG_INFO("set algorithm to dcdfill");
 	}
 		
 	else if(strcmp(argv, "bobsweep") == 0) {
 		target_algorithm = bobsweep_for_nsvg;
+		target_chunkmap_algorithm = bobsweep_chunkmap_for_nsvg;
+		target_shape_finder = bobsweep_find_shapes;
 		LOG_INFO("set algorithm to bobsweep");
 	}
 		
@@ -147,6 +272,71 @@ int set_algorithm(char* argv)
 	return SUCCESS_CODE;
 }
 
+//PUBLIC FACING
+int set_quantizer(char* argv)
+{
+	if(strcmp(argv, "channels") == 0) {
+		target_quantize_method = QUANTIZE_CHANNELS;
+		LOG_INFO("set quantizer to channels");
+	}
+
+	else if(strcmp(argv, "palette") == 0) {
+		target_quantize_method = QUANTIZE_PALETTE;
+		LOG_INFO("set quantizer to palette");
+	}
+
+	else {
+		return BAD_ARGUMENT_ERROR;
+	}
+	return SUCCESS_CODE;
+}
+
+//PUBLIC FACING
+int set_quantize_stage(char* argv)
+{
+	if(strcmp(argv, "image") == 0) {
+		target_quantize_chunks = false;
+		LOG_INFO("set quantize stage to image");
+	}
+
+	else if(strcmp(argv, "chunks") == 0) {
+		target_quantize_chunks = true;
+		LOG_INFO("set quantize stage to chunks");
+	}
+
+	else {
+		return BAD_ARGUMENT_ERROR;
+	}
+	return SUCCESS_CODE;
+}
+
+//PUBLIC FACING
+int set_decode_mode(char* argv)
+{
+	if(strcmp(argv, "image") == 0) {
+		target_decode_to_chunks = false;
+		target_decode_to_bands = false;
+		LOG_INFO("set decode mode to image");
+	}
+
+	else if(strcmp(argv, "chunks") == 0) {
+		target_decode_to_chunks = true;
+		target_decode_to_bands = false;
+		LOG_INFO("set decode mode to chunks");
+	}
+
+	else if(strcmp(argv, "bands") == 0) {
+		target_decode_to_chunks = true;
+		target_decode_to_bands = true;
+		LOG_INFO("set decode mode to bands");
+	}
+
+	else {
+		return BAD_ARGUMENT_ERROR;
+	}
+	return SUCCESS_CODE;
+}
+
 //PUBLIC FACING
 int just_crash() {
 	clear_logfile();
@@ -1,9 +1,26 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 extern const int NUM_COLOURS;
 
 int entrypoint(int argc, char* argv[]);
+// Vectorize a png that is already in memory, or pixels that are already decoded, without going through a file.
+// pixels are rgb or rgba, channels says which, and stride is the number of bytes from one row to the next.
+// The buffer is decoded like a file would be, so a jpeg buffer works too.
+int vectorize_png_buffer(const uint8_t* data, size_t length, int chunk_size, float threshold, int num_colours);
+int vectorize_pixels(const uint8_t* pixels, int width, int height, size_t stride, int channels, int chunk_size, float threshold, int num_colours);
+
+// Vectorize a png while it downloads: push its bytes as they arrive, then finish to write the svg.
+// Finishing frees the stream, also when pushing failed.
+struct png_stream* start_png_stream(int chunk_size, float threshold, int num_colours);
+int push_png_stream(struct png_stream* stream, const uint8_t* data, size_t length);
+int finish_png_stream_to_svg(struct png_stream* stream);
 int set_algorithm(char* argv);
+int set_quantizer(char* argv);
+int set_quantize_stage(char* argv);
+int set_decode_mode(char* argv);
 int just_crash();
 
 extern const char* format1_p;
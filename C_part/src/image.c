@@ -6,6 +6,9 @@
 #include <stdlib.h>
 #include <nanosvg.h>
 #include <stdbool.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
 
 #include "utility/logger.h"
 #include "utility/error.h"
@@ -16,7 +19,6 @@ pixel convert_colorf_to_pixel(pixelF input)
     out.r = rintf(input.r * 255.f);
     out.g = rintf(input.g * 255.f);
     out.b = rintf(input.b * 255.f);
-    out.location = input.location;
     return out;
 }
 
@@ -26,7 +28,6 @@ pixelF convert_pixel_to_colorf(pixel input)
     out.r = (float)input.r / 255.f;
     out.g = (float)input.g / 255.f;
     out.b = (float)input.b / 255.f;
-    out.location = input.location;
     return out;
 }
 
@@ -81,47 +82,84 @@ bool colours_are_similar(pixel color_a, pixel color_b, float max_distance)
     return abc <= max_distance; // If difference less than the threshold
 }
 
+int similarity_limit(float max_distance)
+{
+    int max_squared = 255 * 255 * 3;
+
+    if (!(max_distance >= 0.f))
+        return -1;
+
+    if (max_distance >= sqrtf((float)max_squared))
+        return max_squared;
+
+    // start from the square and walk to the exact edge of what sqrtf accepts, so integer comparisons agree with colours_are_similar
+    int limit = (int)(max_distance * max_distance);
+
+    while (limit < max_squared && sqrtf((float)(limit + 1)) <= max_distance)
+        ++limit;
+
+    while (limit >= 0 && sqrtf((float)limit) > max_distance)
+        --limit;
+
+    return limit;
+}
+
+void* allocate_aligned(size_t size)
+{
+#ifdef _WIN32
+    return _aligned_malloc(size, IMAGE_ALIGNMENT);
+#else
+    void* output = NULL;
+
+    if (posix_memalign(&output, IMAGE_ALIGNMENT, size) != 0)
+        return NULL;
+
+    return output;
+#endif
+}
+
+void free_aligned(void* subject)
+{
+#ifdef _WIN32
+    _aligned_free(subject);
+#else
+    free(subject);
+#endif
+}
+
 image create_image(int width, int height)
 {
     image output = {
-        width, height
+        width, height, 0, NULL
     };
 
     LOG_INFO("Creating Image with %d x %d Dimensions", width, height);
 
-    output.pixels_array_2d = calloc(1, sizeof(pixel*) * width);
+    // Round the row length up so every row starts on an aligned boundary, whatever sizeof(pixel) is
+    output.stride = (width + IMAGE_ALIGNMENT - 1) / IMAGE_ALIGNMENT * IMAGE_ALIGNMENT;
+    size_t size = sizeof(pixel) * (size_t)output.stride * (size_t)height;
+    output.pixels = allocate_aligned(size);
 
-    for (int i = 0; i < width; ++i)
+    if (!output.pixels)
     {
-        output.pixels_array_2d[i] = calloc(1, sizeof(pixel) * height);
+        LOG_ERR("could not allocate %zu bytes for image", size);
+        setError(ASSUMPTION_WRONG);
+        return (image){ 0 };
     }
+    memset(output.pixels, 0, size);
     return output;
 }
 
+pixel* get_image_row(image img, int y)
+{
+    return &img.pixels[(size_t)y * img.stride];
+}
+
 void free_image_contents(image img)
 {
-    if (!img.pixels_array_2d) {
+    if (!img.pixels) {
         LOG_ERR("image has null pointers");
         return;
     }
-    
-    for (int i = 0; i < img.width; ++i)
-    {
-        pixel* current = img.pixels_array_2d[i];
-
-        if(current) {     
-            free(current);            
-        }
-
-        else
-            LOG_ERR("pixel is null");
-    }
-
-    if(img.pixels_array_2d) {
-        free(img.pixels_array_2d);
-    }
-
-    else {
-        LOG_ERR("pixel collection is null");
-    }
+    free_aligned(img.pixels);
 }
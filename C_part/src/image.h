@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef struct colour
 {
@@ -21,7 +22,6 @@ typedef struct
     double r;
     double g;
     double b;
-    coordinate location;
 } pixelD;
 
 // RGB floating point color struct
@@ -31,26 +31,33 @@ typedef struct
     float r;
     float g;
     float b;
-    coordinate location;
 } pixelF;
 
 // RGB 8-bit color struct
 // Values stored as values between 0-255
+// Packed into 3 bytes so an image row has the same layout as an RGB png row.
+// A pixel's position is implied by its index in the image.
 typedef struct
 {
     byte r;
     byte g;
     byte b;
-    coordinate location;
 } pixel;
 
 typedef pixel* pixelp;
 
+enum image_consts {
+    IMAGE_ALIGNMENT = 64 // byte alignment of the pixel buffer and of every row within it
+};
+
+// Pixels are stored row-major in one aligned allocation.
+// stride is the number of pixels between the starts of two consecutive rows (stride >= width)
 typedef struct
 {
     int width;
     int height;
-    pixel** pixels_array_2d;
+    int stride;
+    pixel* pixels;
 } image;
 
 
@@ -64,6 +71,11 @@ pixelF convert_colour_to_pixelf(colour input);
 bool pixelf_equal(pixelF a, pixelF b);
 int calculate_int_units(int subject);
 bool colours_are_similar(pixel color_a, pixel color_b, float max_distance);
+// The biggest squared distance colours_are_similar still accepts for max_distance, -1 when nothing is similar
+int similarity_limit(float max_distance);
 char* rgb_to_string(pixel* input);
+void* allocate_aligned(size_t size); //IMAGE_ALIGNMENT aligned, give it back with free_aligned
+void free_aligned(void* subject);
 image create_image(int width, int height);
+pixel* get_image_row(image img, int y);
 void free_image_contents(image img);
@@ -90,19 +90,21 @@ void generateBitmapImage(unsigned char* image, int height, int width, char* imag
 
 
 void write_image_to_bmp(image img, char* fileaddress_p) {
-    if (!img.pixels_array_2d || !fileaddress_p)
+    if (!img.pixels || !fileaddress_p)
         return;
 
     unsigned char *as_bytes = calloc(1, BYTES_PER_PIXEL * img.height * img.width);
 
-    for (int x = 0; x < img.width; ++x)
+    for (int y = 0; y < img.height; ++y)
     {
-        for (int y = 0; y < img.height; ++y)
+        pixel* img_row = get_image_row(img, y);
+
+        for (int x = 0; x < img.width; ++x)
         {
             int index = x * 3 + 0 + y * BYTES_PER_PIXEL * img.width;
-            as_bytes[index]     = img.pixels_array_2d[x][y].b;
-            as_bytes[index + 1] = img.pixels_array_2d[x][y].g;
-            as_bytes[index + 2] = img.pixels_array_2d[x][y].r;
+            as_bytes[index]     = img_row[x].b;
+            as_bytes[index + 1] = img_row[x].g;
+            as_bytes[index + 2] = img_row[x].r;
         }
     }
     generateBitmapImage(as_bytes, img.height, img.width, fileaddress_p);
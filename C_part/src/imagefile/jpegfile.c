@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+
+#include "jpegfile.h"
+#include "../image.h"
+#include "../utility/error.h"
+#include "../utility/logger.h"
+#include "../utility/mappedfile.h"
+
+// libjpeg's error handler, with somewhere to jump back to
+typedef struct
+{
+    struct jpeg_error_mgr manager;
+    jmp_buf jump;
+} jpeg_error_jump;
+
+// libjpeg exits the program on an error unless it is told to jump somewhere else
+void jump_on_jpeg_error(j_common_ptr info)
+{
+    char message[JMSG_LENGTH_MAX];
+    info->err->format_message(info, message);
+    LOG_ERR("libjpeg failed: %s", message);
+    longjmp(((jpeg_error_jump*)info->err)->jump, 1);
+}
+
+// Warnings go in the log instead of stderr
+void log_jpeg_message(j_common_ptr info)
+{
+    char message[JMSG_LENGTH_MAX];
+    info->err->format_message(info, message);
+    LOG_INFO("libjpeg: %s", message);
+}
+
+// At 1/8 every decoded pixel comes from the DC term of its 8x8 block alone, which is the block's mean up to rounding.
+// The 1/2 and 1/4 inverse DCTs keep a few of the low frequencies, which is not the same as averaging, so they are left out.
+int jpeg_scale_for_chunks(int chunk_size)
+{
+    return chunk_size % 8 == 0 ? 8 : 1;
+}
+
+bool is_jpeg_signature(const uint8_t* header, size_t length)
+{
+    return length >= 3 && header[0] == 0xff && header[1] == 0xd8 && header[2] == 0xff;
+}
+
+// Points libjpeg's errors at error. Do this on a zeroed info before anything else, so it can always be destroyed.
+void set_jpeg_error_jump(struct jpeg_decompress_struct* info, jpeg_error_jump* error)
+{
+    info->err = jpeg_std_error(&error->manager);
+    error->manager.error_exit = jump_on_jpeg_error;
+    error->manager.output_message = log_jpeg_message;
+}
+
+// Reads the header, asks for rgb pixels 1 / scale of the size and starts decoding.
+// Gives back the scale it is decoding at, 0 when the jpeg can't be read this way.
+int read_jpeg_header(struct jpeg_decompress_struct* info, int scale)
+{
+    jpeg_read_header(info, TRUE);
+    info->out_color_space = JCS_RGB; //greyscale comes out as rgb too
+    info->scale_num = 1;
+    info->scale_denom = scale;
+    jpeg_calc_output_dimensions(info);
+
+    // every decoded pixel has to be exactly one block, not whatever scale libjpeg picked instead
+    if (info->output_width != (info->image_width + scale - 1) / scale
+        || info->output_height != (info->image_height + scale - 1) / scale)
+    {
+        LOG_INFO("libjpeg can't decode at 1/%d of the size, decoding every pixel", scale);
+        scale = 1;
+        info->scale_denom = 1;
+    }
+    jpeg_start_decompress(info);
+
+    if (info->output_components != sizeof(pixel))
+    {
+        LOG_ERR("decoded jpeg has %d components, expected packed rgb", info->output_components);
+        setError(NOT_JPEG);
+        return 0;
+    }
+    return scale;
+}
+
+// Decodes the jpeg a scanline at a time straight into its row of output.
+// Gives back false when the jpeg can't be read, output may hold a partly read image then.
+bool decode_jpeg_rows(struct jpeg_decompress_struct* info, jpeg_error_jump* error, const uint8_t* data, size_t length, int* scale, image* output)
+{
+    if (setjmp(error->jump))
+    {
+        setError(READ_FILE_ERROR);
+        return false;
+    }
+    jpeg_create_decompress(info);
+    jpeg_mem_src(info, data, length);
+    int used_scale = read_jpeg_header(info, *scale);
+
+    if (!used_scale)
+        return false; //scale stays what was asked for, callers divide by it
+
+    *scale = used_scale;
+
+    *output = create_image(info->output_width, info->output_height);
+
+    if (isBadError())
+        return false;
+
+    LOG_INFO("reading %d x %d jpeg at 1/%d of its size...", info->image_width, info->image_height, *scale);
+
+    while (info->output_scanline < info->output_height)
+    {
+        JSAMPROW row = (JSAMPROW)get_image_row(*output, info->output_scanline);
+        jpeg_read_scanlines(info, &row, 1);
+    }
+    jpeg_finish_decompress(info);
+    return true;
+}
+
+// Everything decode_jpeg_chunks allocates, held by the caller so it can be freed whatever libjpeg does
+typedef struct
+{
+    image row;
+    chunk_accumulator* accumulator;
+} jpeg_chunk_decoding;
+
+// Decodes the jpeg a scanline at a time and adds every scanline onto the chunks it belongs to
+bool decode_jpeg_chunks(struct jpeg_decompress_struct* info, jpeg_error_jump* error, const uint8_t* data, size_t length, vectorize_options options, jpeg_chunk_decoding* decoding)
+{
+    if (setjmp(error->jump))
+    {
+        setError(READ_FILE_ERROR);
+        return false;
+    }
+    jpeg_create_decompress(info);
+    jpeg_mem_src(info, data, length);
+    int scale = read_jpeg_header(info, jpeg_scale_for_chunks(options.chunk_size));
+
+    if (!scale)
+        return false;
+
+    options.chunk_size /= scale; //the inverse DCT already averaged each 8x8 block, near enough
+    decoding->accumulator = create_chunk_accumulator(info->output_width, info->output_height, options);
+
+    if (isBadError())
+        return false;
+
+    decoding->row = create_image(info->output_width, 1);
+
+    if (isBadError())
+        return false;
+
+    LOG_INFO("decoding %d x %d jpeg at 1/%d of its size into chunks of %d...", info->image_width, info->image_height, scale, options.chunk_size);
+    JSAMPROW row = (JSAMPROW)get_image_row(decoding->row, 0);
+
+    while (info->output_scanline < info->output_height && !isBadError())
+    {
+        jpeg_read_scanlines(info, &row, 1);
+        accumulate_pixel_row(decoding->accumulator, (pixel*)row);
+    }
+
+    if (isBadError())
+        return false;
+
+    jpeg_finish_decompress(info);
+    return true;
+}
+
+bool check_jpeg_buffer(const uint8_t* data, size_t length)
+{
+    if (!data)
+    {
+        LOG_ERR("jpeg buffer not given");
+        setError(NULL_ARGUMENT_ERROR);
+        return false;
+    }
+
+    if (!is_jpeg_signature(data, length))
+    {
+        LOG_ERR("buffer of %zu bytes was not recognised as a JPEG", length);
+        setError(NOT_JPEG);
+        return false;
+    }
+    return true;
+}
+
+image convert_jpeg_buffer_to_image(const uint8_t* data, size_t length, int* scale)
+{
+    LOG_INFO("converting %zu byte jpeg buffer to image struct...", length);
+
+    if (!check_jpeg_buffer(data, length))
+        return (image){ 0 };
+
+    struct jpeg_decompress_struct info = { 0 };
+    jpeg_error_jump error;
+    set_jpeg_error_jump(&info, &error);
+
+    image output = { 0 };
+    bool decoded = decode_jpeg_rows(&info, &error, data, length, scale, &output);
+    jpeg_destroy_decompress(&info);
+
+    if (!decoded)
+    {
+        if (output.pixels)
+            free_image_contents(output);
+
+        return (image){ 0 };
+    }
+    return output;
+}
+
+chunkmap* convert_jpeg_buffer_to_chunkmap(const uint8_t* data, size_t length, vectorize_options options)
+{
+    LOG_INFO("converting %zu byte jpeg buffer straight to chunkmap...", length);
+
+    if (!check_jpeg_buffer(data, length))
+        return NULL;
+
+    struct jpeg_decompress_struct info = { 0 };
+    jpeg_error_jump error;
+    set_jpeg_error_jump(&info, &error);
+
+    jpeg_chunk_decoding decoding = { 0 };
+    bool decoded = decode_jpeg_chunks(&info, &error, data, length, options, &decoding);
+    jpeg_destroy_decompress(&info);
+
+    if (decoding.row.pixels)
+        free_image_contents(decoding.row);
+
+    if (!decoded)
+    {
+        free_chunk_accumulator(decoding.accumulator);
+        return NULL;
+    }
+    return finish_chunk_accumulator(decoding.accumulator);
+}
+
+image convert_jpeg_to_image(char* fileaddress, int* scale)
+{
+    mapped_file file = map_file(fileaddress);
+
+    if (!file.data)
+        return (image){ 0 };
+
+    image output = convert_jpeg_buffer_to_image(file.data, file.length, scale);
+    unmap_file(file);
+    return output;
+}
+
+chunkmap* convert_jpeg_to_chunkmap(char* fileaddress, vectorize_options options)
+{
+    mapped_file file = map_file(fileaddress);
+
+    if (!file.data)
+        return NULL;
+
+    chunkmap* output = convert_jpeg_buffer_to_chunkmap(file.data, file.length, options);
+    unmap_file(file);
+    return output;
+}
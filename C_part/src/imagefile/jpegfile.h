@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "../image.h"
+#include "../chunkmap.h"
+
+// How many times smaller libjpeg's scaled inverse DCT should decode a jpeg for chunks of chunk_size,
+// 8 when chunk_size divides by 8 and 1 otherwise. A pixel decoded at 1/8 is close to the mean of its 8x8 block, not exactly it:
+// the colour conversion rounds after averaging instead of before, and subsampled chroma comes from a block twice as big,
+// so pixels next to sharp colour edges can be a few dozen levels off in a 4:2:0 jpeg.
+int jpeg_scale_for_chunks(int chunk_size);
+bool is_jpeg_signature(const uint8_t* header, size_t length);
+
+// Decodes a jpeg scale times smaller than it is, scale 1 gives every pixel.
+// Gives back the scale libjpeg actually used in scale, 1 when it could not do the one asked for, and leaves it alone on failure.
+image convert_jpeg_to_image(char* fileaddress, int* scale);
+// Averages the jpeg into a chunkmap while decoding it a scanline at a time.
+// The decoder does as much of the averaging as options.chunk_size allows, so the map's input is the scaled down image.
+chunkmap* convert_jpeg_to_chunkmap(char* fileaddress, vectorize_options options);
+// The same from a jpeg held in memory, nothing touches the filesystem
+image convert_jpeg_buffer_to_image(const uint8_t* data, size_t length, int* scale);
+chunkmap* convert_jpeg_buffer_to_chunkmap(const uint8_t* data, size_t length, vectorize_options options);
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "loader.h"
+#include "pngfile.h"
+#include "jpegfile.h"
+#include "../utility/logger.h"
+#include "../utility/error.h"
+#include "../utility/mappedfile.h"
+
+// Decodes a mapped jpeg, and takes what the decoder already averaged off options->chunk_size
+image load_jpeg_buffer(mapped_file file, vectorize_options* options)
+{
+    int scale = jpeg_scale_for_chunks(options->chunk_size);
+    image output = convert_jpeg_buffer_to_image(file.data, file.length, &scale);
+
+    if (!output.pixels)
+        return output;
+
+    options->chunk_size /= scale;
+    LOG_INFO("jpeg decoded at 1/%d of its size, chunks of %d left", scale, options->chunk_size);
+    return output;
+}
+
+// Anything that isn't a jpeg goes to the png decoder, which says what is wrong with it
+chunkmap* load_buffer_to_chunkmap(mapped_file file, vectorize_options options)
+{
+    if (is_jpeg_signature(file.data, file.length))
+        return convert_jpeg_buffer_to_chunkmap(file.data, file.length, options);
+
+    return convert_png_buffer_to_chunkmap(file.data, file.length, options);
+}
+
+image load_image_file(vectorize_options* options)
+{
+    mapped_file file = map_file(options->file_path);
+
+    if (!file.data)
+        return (image){ 0 };
+
+    image output = is_jpeg_signature(file.data, file.length) ? load_jpeg_buffer(file, options) : convert_png_buffer_to_image(file.data, file.length);
+    unmap_file(file);
+    return output;
+}
+
+chunkmap* load_image_file_to_chunkmap(vectorize_options options)
+{
+    mapped_file file = map_file(options.file_path);
+
+    if (!file.data)
+        return NULL;
+
+    chunkmap* output = load_buffer_to_chunkmap(file, options);
+    unmap_file(file);
+    return output;
+}
+
+decoded_image_file decode_image_buffer(const uint8_t* data, size_t length, vectorize_options* options)
+{
+    mapped_file file = { data, length }; //the loaders only read it, it is never unmapped
+    decoded_image_file output = { 0 };
+    bool jpeg = is_jpeg_signature(file.data, file.length);
+
+    // a png with its own palette goes to chunks too, its colours are already picked so there is nothing to quantize
+    if (options->decode_to_chunks || (!jpeg && png_buffer_keeps_palette(file.data, file.length, *options)))
+        output.map = load_buffer_to_chunkmap(file, *options);
+
+    else if (!isBadError())
+        output.img = jpeg ? load_jpeg_buffer(file, options) : convert_png_buffer_to_image(file.data, file.length);
+
+    return output;
+}
+
+decoded_image_file decode_image_file(vectorize_options* options)
+{
+    mapped_file file = map_file(options->file_path);
+
+    if (!file.data)
+        return (decoded_image_file){ 0 };
+
+    decoded_image_file output = decode_image_buffer(file.data, file.length, options);
+    unmap_file(file);
+    return output;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../image.h"
+#include "../chunkmap.h"
+
+// Decodes options->file_path whether it is a png or a jpeg.
+// A jpeg can come out already averaged by part of options->chunk_size, options->chunk_size is then what is left to do.
+image load_image_file(vectorize_options* options);
+// Averages options.file_path into a chunkmap while decoding it, whether it is a png or a jpeg
+chunkmap* load_image_file_to_chunkmap(vectorize_options options);
+// A decoded file, map when it was decoded straight to chunks and img when it was decoded whole
+typedef struct
+{
+    image img;
+    chunkmap* map;
+} decoded_image_file;
+
+// Maps options->file_path once and decodes it straight to chunks when options->decode_to_chunks asks for it
+// or the file is a png with a palette num_colours can hold, which needs neither the full image nor quantizing.
+// Otherwise decodes the full image like load_image_file, options->chunk_size is then what is left to do.
+decoded_image_file decode_image_file(vectorize_options* options);
+// The same for a png or jpeg that is already in memory
+decoded_image_file decode_image_buffer(const uint8_t* data, size_t length, vectorize_options* options);
@@ -1,217 +1,565 @@
 #include <png.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
 
 #include "pngfile.h"
 #include "../image.h"
 #include "../utility/error.h"
 #include "../utility/logger.h"
+#include "../utility/mappedfile.h"
 
-/// Takes a filename (assumed to be a png file), and creates an image struct full of the png's pixels
-/// 
-/// Steps involve:
-/// Open the file for reading
-/// Create necessary libpng structs and populate them
-/// Allocate memory to hold the image contents
-/// Read the image into the memory
-/// Convert the obtained memory into a contiguous format (convert the row pointers from a 2 dimensional array into a single array)
-image convert_png_to_image(char* fileaddress) {
-    LOG_INFO("converting png to image struct...");
-    LOG_INFO("opening image file...");
+// Whether the png comes with a palette num_colours can hold, then it is decoded to palette indices and never quantized
+bool png_palette_fits(png_structp read_struct, png_infop info, vectorize_options options)
+{
+    png_colorp colours;
+    int count;
 
-    if (fileaddress == NULL) {
-        LOG_ERR("fileaddress not given");
-        setError(NULL_ARGUMENT_ERROR);
-        return (image){NULL, 0, 0};
+    return png_get_color_type(read_struct, info) == PNG_COLOR_TYPE_PALETTE
+        && png_get_PLTE(read_struct, info, &colours, &count)
+        && count <= options.num_colours;
+}
+
+// Sets up the transforms that turn every decoded row into packed pixels, or a byte per palette index when indexed, once the header is in info.
+// Gives back how many interlace passes the rows come in, 0 when the png can't be read this way.
+int setup_png_rows(png_structp read_struct, png_infop info, bool indexed)
+{
+    png_byte color_type = png_get_color_type(read_struct, info);
+    png_byte bit_depth = png_get_bit_depth(read_struct, info);
+
+    if (indexed)
+    {
+        LOG_INFO("Type is palette, keeping the indices");
+        png_set_packing(read_struct); //indices under 8 bits get a byte each
     }
+    else
+    {
+        if (color_type == PNG_COLOR_TYPE_PALETTE)
+        {
+            LOG_INFO("Type is palette, expanding to RGB");
+            png_set_palette_to_rgb(read_struct);
+        }
+
+        if (!(color_type & PNG_COLOR_MASK_COLOR))
+        {
+            LOG_INFO("Type is greyscale, expanding to RGB");
+
+            if (bit_depth < 8)
+                png_set_expand_gray_1_2_4_to_8(read_struct);
+
+            png_set_gray_to_rgb(read_struct);
+        }
 
-    /// Open File
-    FILE* file_p = fopen(fileaddress, "rb");
+        if (bit_depth == 16)
+        {
+            LOG_INFO("Depth is 16 bits, stripping to 8");
+            png_set_strip_16(read_struct);
+        }
 
-    if (!file_p)
+        if ((color_type & PNG_COLOR_MASK_ALPHA) || png_get_valid(read_struct, info, PNG_INFO_tRNS))
+        {
+            LOG_INFO("Image has alpha, stripping it");
+            png_set_strip_alpha(read_struct);
+        }
+    }
+    int passes = png_set_interlace_handling(read_struct); //every pass of an interlaced png fills in more of the same rows
+    png_read_update_info(read_struct, info);
+
+    size_t row_bytes = png_get_image_width(read_struct, info) * (indexed ? 1 : sizeof(pixel));
+
+    if (png_get_rowbytes(read_struct, info) != row_bytes)
     {
-        LOG_ERR("Could not open file '%s' for reading", fileaddress);
+        LOG_ERR("decoded rows are %zu bytes, expected %zu", (size_t)png_get_rowbytes(read_struct, info), row_bytes);
         setError(ASSUMPTION_WRONG);
-        return (image){NULL, 0, 0};
+        return 0;
     }
+    return passes;
+}
 
-    /// Verify File
-    LOG_INFO("Checking if file is PNG type");
+// Reads the header and sets up the transforms
+int read_png_header(png_structp read_struct, png_infop info)
+{
+    png_read_info(read_struct, info);
+    return setup_png_rows(read_struct, info, false);
+}
 
-    unsigned char header[8];
-    fread(header, 1, 8, file_p);
-    if (png_sig_cmp(header, 0, 8))
+// Decodes the png a row at a time straight into its row of output.
+// Gives back false when the png can't be read, output may hold a partly read image then.
+bool decode_png_rows(png_structp read_struct, png_infop info, image* output)
+{
+    if (setjmp(png_jmpbuf(read_struct)))
     {
-        LOG_ERR("File \'%s\' was not recognised as a PNG file", fileaddress);
-        setError(NOT_PNG);
-        return (image){NULL, 0, 0};
+        LOG_ERR("libpng failed while decoding the image");
+        setError(READ_FILE_ERROR);
+        return false;
     }
-    
-    /// Prepare and read structs
-    LOG_INFO("Creating png_image struct");
+    int passes = read_png_header(read_struct, info);
 
-    png_byte color_type, bit_depth;
+    if (!passes)
+        return false;
 
-    // Return struct
-    png_image image_struct;
-    image_struct.opaque = NULL; 
-    image_struct.version = PNG_IMAGE_VERSION;
+    LOG_INFO("Reading image width/height and allocating image space");
+    *output = create_image(png_get_image_width(read_struct, info), png_get_image_height(read_struct, info));
 
-    LOG_INFO("creating pnglib read struct...");
+    if (isBadError())
+        return false;
 
-    png_structp read_struct = png_create_read_struct(
-        PNG_LIBPNG_VER_STRING, NULL, NULL, NULL
-    );
+    LOG_INFO("reading %d x %d image in %d passes...", output->width, output->height, passes);
+
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        for (int y = 0; y < output->height; ++y)
+            png_read_row(read_struct, (png_bytep)get_image_row(*output, y), NULL);
+    }
+    png_read_end(read_struct, NULL);
+    return true;
+}
+
+// Everything decode_png_chunks allocates, held by the caller so it can be freed whatever libpng does
+typedef struct
+{
+    image rows; //one row, or the whole image when it is interlaced and no row is done before the last pass
+    chunk_accumulator* accumulator;
+    bool indexed; //the rows are palette indices, which the accumulator turns into colours
+} png_chunk_decoding;
+
+// Hands a decoded row to the accumulator, as palette indices or as pixels
+void add_png_row(png_chunk_decoding* decoding, png_const_bytep row)
+{
+    if (decoding->indexed)
+        accumulate_indexed_row(decoding->accumulator, row);
+    else
+        accumulate_pixel_row(decoding->accumulator, (const pixel*)row);
+}
+
+// Makes the accumulator and the rows the decoded pixels go through, once the header is read
+bool start_png_chunks(png_structp read_struct, png_infop info, vectorize_options options, int passes, png_chunk_decoding* decoding)
+{
+    int width = png_get_image_width(read_struct, info);
+    int height = png_get_image_height(read_struct, info);
+    decoding->accumulator = create_chunk_accumulator(width, height, options);
+
+    if (isBadError())
+        return false;
 
-    if (!read_struct)
+    if (decoding->indexed)
+    {
+        png_colorp entries;
+        int count;
+        png_get_PLTE(read_struct, info, &entries, &count);
+        pixel colours[MAX_PALETTE_COLOURS];
+
+        for (int i = 0; i < count; ++i)
+            colours[i] = (pixel){ entries[i].red, entries[i].green, entries[i].blue };
+
+        LOG_INFO("keeping the png's palette of %d colours instead of quantizing", count);
+        palette* kept = create_palette_from_colours(colours, count, options.thread_count);
+
+        if (isBadError())
+            return false;
+
+        use_accumulator_palette(decoding->accumulator, kept);
+
+        if (isBadError())
+            return false;
+    }
+    decoding->rows = create_image(width, passes > 1 ? height : 1); //index rows are narrower, they fit as well
+
+    if (isBadError())
+        return false;
+
+    LOG_INFO("decoding %d x %d image into chunks of %d in %d passes...", width, height, options.chunk_size, passes);
+    return true;
+}
+
+// Decodes the png a row at a time and adds every row onto the chunks it belongs to
+bool decode_png_chunks(png_structp read_struct, png_infop info, vectorize_options options, png_chunk_decoding* decoding)
+{
+    if (setjmp(png_jmpbuf(read_struct)))
+    {
+        LOG_ERR("libpng failed while decoding the image");
+        setError(READ_FILE_ERROR);
+        return false;
+    }
+    png_read_info(read_struct, info);
+    decoding->indexed = png_palette_fits(read_struct, info, options);
+    int passes = setup_png_rows(read_struct, info, decoding->indexed);
+
+    if (!passes || !start_png_chunks(read_struct, info, options, passes, decoding))
+        return false;
+
+    int height = png_get_image_height(read_struct, info);
+
+    if (passes == 1)
+    {
+        png_bytep row = (png_bytep)get_image_row(decoding->rows, 0);
+
+        for (int y = 0; y < height && !isBadError(); ++y)
+        {
+            png_read_row(read_struct, row, NULL);
+            add_png_row(decoding, row);
+        }
+    }
+    else
+    {
+        for (int pass = 0; pass < passes; ++pass)
+        {
+            for (int y = 0; y < height; ++y)
+                png_read_row(read_struct, (png_bytep)get_image_row(decoding->rows, y), NULL);
+        }
+
+        for (int y = 0; y < height && !isBadError(); ++y)
+            add_png_row(decoding, (png_bytep)get_image_row(decoding->rows, y));
+    }
+
+    if (isBadError())
+        return false;
+
+    png_read_end(read_struct, NULL);
+    return true;
+}
+
+// The libpng read structs for a png whose signature was already checked, the caller still has to say where the bytes come from
+bool create_png_read_structs(png_structp* read_struct, png_infop* info)
+{
+    LOG_INFO("creating pnglib read struct...");
+    *read_struct = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+
+    if (!*read_struct)
     {
         LOG_ERR("Failed to create png read struct");
         setError(READ_FILE_ERROR);
-        return (image){NULL, 0, 0};
+        return false;
     }
-    
+
     LOG_INFO("Creating pnglib info struct...");
-    png_infop info = png_create_info_struct(read_struct);
+    *info = png_create_info_struct(*read_struct);
 
-    if (!info)
+    if (!*info)
     {
         LOG_ERR("Error: png_create_info_struct failed");
         setError(READ_FILE_ERROR);
-        return (image) { NULL, 0, 0 };
+        png_destroy_read_struct(read_struct, NULL, NULL);
+        return false;
     }
+    png_set_sig_bytes(*read_struct, 8);
+    return true;
+}
 
-    if (setjmp(png_jmpbuf(read_struct)))
+// Decodes the whole png into an image, and destroys the read structs
+image read_png_image(png_structp read_struct, png_infop info)
+{
+    LOG_INFO("Beginning PNG Reading");
+    image output = { 0 };
+    bool decoded = decode_png_rows(read_struct, info, &output);
+    png_destroy_read_struct(&read_struct, &info, NULL);
+
+    if (!decoded)
     {
-        LOG_ERR("Error during init_io");
-        png_destroy_read_struct(read_struct, info, NULL);
-        return (image) { NULL, 0, 0 };
+        if (output.pixels)
+            free_image_contents(output);
+
+        return (image){ 0 };
     }
+    LOG_INFO("png converted to image struct.");
+    return output;
+}
 
-    LOG_INFO("Beginning PNG Reading");
+// Decodes the png into a chunkmap, and destroys the read structs
+chunkmap* read_png_chunkmap(png_structp read_struct, png_infop info, vectorize_options options)
+{
+    LOG_INFO("converting png straight to chunkmap...");
+    png_chunk_decoding decoding = { 0 };
+    bool decoded = decode_png_chunks(read_struct, info, options, &decoding);
+    png_destroy_read_struct(&read_struct, &info, NULL);
 
-    // Start Reading
-    png_init_io(read_struct, file_p);
-    png_set_sig_bytes(read_struct, 8);
+    if (decoding.rows.pixels)
+        free_image_contents(decoding.rows);
 
+    if (!decoded)
+    {
+        free_chunk_accumulator(decoding.accumulator);
+        return NULL;
+    }
+    return finish_chunk_accumulator(decoding.accumulator);
+}
+
+// Reads as far as the palette, the structs still need destroying
+bool read_png_palette_fits(png_structp read_struct, png_infop info, vectorize_options options)
+{
+    if (setjmp(png_jmpbuf(read_struct)))
+    {
+        LOG_ERR("libpng failed while reading the header");
+        setError(READ_FILE_ERROR);
+        return false;
+    }
     png_read_info(read_struct, info);
+    return png_palette_fits(read_struct, info, options);
+}
 
-    LOG_INFO("Reading image width/height and allocating image space");
-    image output = create_image(png_get_image_width(read_struct, info), png_get_image_height(read_struct, info));
+// Hands libpng the next bytes of an in memory png
+void read_png_buffer(png_structp read_struct, png_bytep output, png_size_t length)
+{
+    png_buffer* input = png_get_io_ptr(read_struct);
 
-    color_type = png_get_color_type(read_struct, info);
-    if (color_type != PNG_COLOR_TYPE_RGB && color_type != PNG_COLOR_TYPE_RGBA)
+    if (length > input->length - input->offset)
+        png_error(read_struct, "png buffer ended early");
+
+    memcpy(output, input->data + input->offset, length);
+    input->offset += length;
+}
+
+// Checks the signature of an in memory png, and points libpng's reads at the rest of it
+bool create_png_buffer_read_structs(png_buffer* input, png_structp* read_struct, png_infop* info)
+{
+    if (!input->data)
     {
-        LOG_ERR("Only RGB/A PNGs are supported for import, format: %d", color_type);
-        setError(NOT_PNG);
-        return (image){NULL, 0, 0};
+        LOG_ERR("png buffer not given");
+        setError(NULL_ARGUMENT_ERROR);
+        return false;
     }
-    bit_depth = png_get_bit_depth(read_struct, info);
-    if (bit_depth != 8) {
-        LOG_ERR("Only 24bpp PNGs are supported, depth: %d", bit_depth * 3);
+
+    if (input->length < 8 || png_sig_cmp(input->data, 0, 8))
+    {
+        LOG_ERR("buffer of %zu bytes was not recognised as a PNG", input->length);
         setError(NOT_PNG);
-        return (image){NULL, 0, 0};
+        return false;
     }
+    input->offset = 8;
 
-    png_read_update_info(read_struct, info);
+    if (!create_png_read_structs(read_struct, info))
+        return false;
 
-    if (setjmp(png_jmpbuf(read_struct)))
-    {
-        LOG_ERR("Error during early PNG reading");
-        setError(READ_FILE_ERROR);
-        png_destroy_read_struct(read_struct, info, NULL);
-        return (image){NULL, 0, 0};
-    }
+    png_set_read_fn(*read_struct, input, read_png_buffer);
+    return true;
+}
 
-    LOG_INFO("Allocating row pointers...");
+image convert_png_buffer_to_image(const uint8_t* data, size_t length) {
+    LOG_INFO("converting %zu byte png buffer to image struct...", length);
+    png_buffer input = { data, length, 0 };
+    png_structp read_struct;
+    png_infop info;
 
-    LOG_INFO("dimensions: %d x %d", output.width, output.height);
+    if (!create_png_buffer_read_structs(&input, &read_struct, &info))
+        return (image){ 0 };
+
+    return read_png_image(read_struct, info);
+}
 
-    // Allocate row pointers to be filled
-    png_bytep* row_pointers_p = calloc(1, sizeof(png_bytep) * output.height);
+chunkmap* convert_png_buffer_to_chunkmap(const uint8_t* data, size_t length, vectorize_options options) {
+    LOG_INFO("converting %zu byte png buffer to chunkmap...", length);
+    png_buffer input = { data, length, 0 };
+    png_structp read_struct;
+    png_infop info;
+
+    if (!create_png_buffer_read_structs(&input, &read_struct, &info))
+        return NULL;
+
+    return read_png_chunkmap(read_struct, info, options);
+}
 
-    for (int y = 0; y < output.height; ++y)
+
+/// Takes a filename (assumed to be a png file), and creates an image struct full of the png's pixels
+/// 
+/// Steps involve:
+/// Map the file into memory, so libpng reads the pages straight out of the page cache instead of through stdio
+/// Create necessary libpng structs and populate them
+/// Decode the png one row at a time into the image's own rows, so the pixels are never held twice
+image convert_png_to_image(char* fileaddress) {
+    LOG_INFO("converting png to image struct...");
+    mapped_file file = map_file(fileaddress);
+
+    if (!file.data)
+        return (image){ 0 };
+
+    image output = convert_png_buffer_to_image(file.data, file.length);
+    unmap_file(file);
+    return output;
+}
+
+chunkmap* convert_png_to_chunkmap(char* fileaddress, vectorize_options options) {
+    mapped_file file = map_file(fileaddress);
+
+    if (!file.data)
+        return NULL;
+
+    chunkmap* output = convert_png_buffer_to_chunkmap(file.data, file.length, options);
+    unmap_file(file);
+    return output;
+}
+
+bool png_buffer_keeps_palette(const uint8_t* data, size_t length, vectorize_options options) {
+    png_buffer input = { data, length, 0 };
+    png_structp read_struct;
+    png_infop info;
+    bool fits = false;
+
+    if (create_png_buffer_read_structs(&input, &read_struct, &info))
     {
-        row_pointers_p[y] = calloc(1, png_get_rowbytes(read_struct, info));
+        fits = read_png_palette_fits(read_struct, info, options);
+        png_destroy_read_struct(&read_struct, &info, NULL);
     }
+    return fits;
+}
 
-    LOG_INFO("reading the image...");
-    
-    // Switch to RGB format, and fill the row pointers with values
-    image_struct.format = PNG_FORMAT_RGB;
-    png_read_image(read_struct, row_pointers_p);
+bool png_file_keeps_palette(char* fileaddress, vectorize_options options) {
+    mapped_file file = map_file(fileaddress);
 
-    LOG_INFO("closing image file...");
+    if (!file.data)
+        return false;
 
-    // Clean up the file
-    fclose(file_p);
-    png_destroy_read_struct(&read_struct, &info, NULL);
-    
-    LOG_INFO("putting dereferenced row pointers in custom struct...");
+    bool fits = png_buffer_keeps_palette(file.data, file.length, options);
+    unmap_file(file);
+    return fits;
+}
+
+
+struct png_stream
+{
+    png_structp read_struct;
+    png_infop info;
+    vectorize_options options;
+    png_chunk_decoding decoding;
+    int passes; //0 until the header has come in
+    bool finished; //libpng has seen the end of the png
+    bool failed;
+};
+
+// libpng has the whole header, get the rows ready
+void png_stream_info(png_structp read_struct, png_infop info)
+{
+    png_stream* stream = png_get_progressive_ptr(read_struct);
+    stream->decoding.indexed = png_palette_fits(read_struct, info, stream->options);
+    stream->passes = setup_png_rows(read_struct, info, stream->decoding.indexed);
 
-    if (color_type == PNG_COLOR_TYPE_RGB)
+    if (!stream->passes || !start_png_chunks(read_struct, info, stream->options, stream->passes, &stream->decoding))
+        png_error(read_struct, "could not start decoding the png stream");
+}
+
+// One more row is decoded. Rows of a plain png go straight into the accumulator,
+// an interlaced png's passes get combined into the full image until the last one is done.
+void png_stream_row(png_structp read_struct, png_bytep new_row, png_uint_32 row_number, int pass)
+{
+    (void)pass; //png_progressive_combine_row knows the pass by itself
+    png_stream* stream = png_get_progressive_ptr(read_struct);
+
+    if (stream->passes == 1)
+    {
+        add_png_row(&stream->decoding, new_row);
+    }
+    else
     {
-        LOG_INFO("Type is RGB");
+        png_progressive_combine_row(read_struct, (png_bytep)get_image_row(stream->decoding.rows, row_number), new_row);
+    }
 
-        for (int y = 0; y < output.height; ++y)
-        {
-            png_byte *row_p = row_pointers_p[y];
+    if (isBadError())
+        png_error(read_struct, "could not add row to chunks");
+}
 
-            for (int x = 0; x < output.width; ++x)
-            {
-                png_byte *pixel_p = &(row_p[x * 3]);
+void png_stream_end(png_structp read_struct, png_infop info)
+{
+    (void)info;
+    png_stream* stream = png_get_progressive_ptr(read_struct);
+    stream->finished = true;
 
-                output.pixels_array_2d[x][y].r = pixel_p[0];
-                output.pixels_array_2d[x][y].g = pixel_p[1];
-                output.pixels_array_2d[x][y].b = pixel_p[2];
+    if (stream->passes > 1)
+    {
+        for (int y = 0; y < stream->decoding.rows.height && !isBadError(); ++y)
+            add_png_row(&stream->decoding, (png_bytep)get_image_row(stream->decoding.rows, y));
+    }
+}
 
-                output.pixels_array_2d[x][y].location = (coordinate){
-                    x, y,
-                };
-            }
-        }
+png_stream* create_png_stream(vectorize_options options)
+{
+    png_stream* output = calloc(1, sizeof(png_stream));
+
+    if (!output)
+    {
+        LOG_ERR("could not allocate png stream");
+        setError(ASSUMPTION_WRONG);
+        return NULL;
     }
-    else if (color_type == PNG_COLOR_TYPE_RGBA)
+    output->options = options;
+    output->read_struct = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    output->info = output->read_struct ? png_create_info_struct(output->read_struct) : NULL;
+
+    if (!output->info)
     {
-        LOG_INFO("Type is RGBA");
+        LOG_ERR("Failed to create png read structs");
+        setError(READ_FILE_ERROR);
+        free_png_stream(output);
+        return NULL;
+    }
+    png_set_progressive_read_fn(output->read_struct, output, png_stream_info, png_stream_row, png_stream_end);
+    return output;
+}
 
-        for (int y = 0; y < output.height; ++y)
-        {
-            png_byte *row_p = row_pointers_p[y];
+void push_png_bytes(png_stream* stream, const uint8_t* data, size_t length)
+{
+    if (stream->failed || stream->finished)
+    {
+        LOG_ERR("png stream can not take more bytes, it has %s", stream->failed ? "failed" : "finished");
+        setError(BAD_ARGUMENT_ERROR);
+        return;
+    }
 
-            for (int x = 0; x < output.width; ++x)
-            {
-                png_byte *pixel_p = &(row_p[x * 4]);
+    if (setjmp(png_jmpbuf(stream->read_struct)))
+    {
+        LOG_ERR("libpng failed while decoding the png stream");
+        stream->failed = true;
 
-                output.pixels_array_2d[x][y].r = pixel_p[0];
-                output.pixels_array_2d[x][y].g = pixel_p[1];
-                output.pixels_array_2d[x][y].b = pixel_p[2];
+        if (!isBadError())
+            setError(READ_FILE_ERROR);
 
-                output.pixels_array_2d[x][y].location = (coordinate){
-                    x, y,
-                    1, 1
-                };
-            }
-        }
+        return;
     }
+    png_process_data(stream->read_struct, stream->info, (png_bytep)data, length); //libpng only reads the bytes
+}
+
+chunkmap* finish_png_stream(png_stream* stream)
+{
+    chunkmap* output = NULL;
+
+    if (stream->failed || !stream->finished || isBadError())
+    {
+        LOG_ERR("png stream ended %s", stream->failed ? "after an error" : "before the png was complete");
 
+        if (!isBadError())
+            setError(READ_FILE_ERROR);
+    }
     else
     {
-        LOG_INFO("color type is not RGBA");
+        output = finish_chunk_accumulator(stream->decoding.accumulator);
+        stream->decoding.accumulator = NULL;
     }
-
-    for (int i = 0; i < output.height; ++i)
-        free(row_pointers_p[i]);
-        
-    free(row_pointers_p);
-    
-    LOG_INFO("png file converted to image struct.");
+    free_png_stream(stream);
     return output;
 }
 
+vectorize_options get_png_stream_options(png_stream* stream)
+{
+    return stream->options;
+}
+
+void free_png_stream(png_stream* stream)
+{
+    if (!stream)
+        return;
+
+    if (stream->read_struct)
+        png_destroy_read_struct(&stream->read_struct, stream->info ? &stream->info : NULL, NULL);
+
+    if (stream->decoding.rows.pixels)
+        free_image_contents(stream->decoding.rows);
+
+    free_chunk_accumulator(stream->decoding.accumulator);
+    free(stream);
+}
 
 void write_image_to_png(image img, char* fileaddress)
 {
-    if (!img.pixels_array_2d || !fileaddress) {
+    if (!img.pixels || !fileaddress) {
         LOG_ERR("null arguments given to write_image_to_png");
         setError(NULL_ARGUMENT_ERROR);
         return;
@@ -273,11 +621,13 @@ void write_image_to_png(image img, char* fileaddress)
     for (int y = 0; y < img.height; ++y)
     {
         row_pointers[y] = calloc(img.width, sizeof(png_byte) * 3);
+        pixel* img_row = get_image_row(img, y);
+
         for (int x = 0; x < img.width; ++x)
         {
-            row_pointers[y][x * 3 + 0] = img.pixels_array_2d[x][y].r;
-            row_pointers[y][x * 3 + 1] = img.pixels_array_2d[x][y].g;
-            row_pointers[y][x * 3 + 2] = img.pixels_array_2d[x][y].b;
+            row_pointers[y][x * 3 + 0] = img_row[x].r;
+            row_pointers[y][x * 3 + 1] = img_row[x].g;
+            row_pointers[y][x * 3 + 2] = img_row[x].b;
         }
     }
 
@@ -376,26 +726,23 @@ void write_bytes_to_png(unsigned char* data, int width, int height, char* filead
     png_destroy_write_struct(&png_ptr, &info_ptr);
 }
 
-void iterate_through_shape(pixelchunk_list* list, png_hashies_iter* udata)
+void iterate_through_shape(chunkmap* chunks, chunkshape* shape, png_hashies_iter* udata)
 {
-    pixelchunk_list* current = list;
+    int32_t* indices = chunks->chunk_indices + shape->chunks_offset;
 
-    while(current != NULL) {
-            pixelchunk* chunk = current->chunk_p;
+    for (int i = 0; i < shape->chunks_amount; ++i) {
             png_hashies_iter* stuff = udata;
             colourmap* map = stuff->map;
+            int index = indices[i]; //the colourmap has the same dimensions as the chunkmap
         
-        if (chunk->location.x < 0 || chunk->location.y < 0 || chunk->location.x >= map->width || chunk->location.y >= map->height)
+        if (index < 0 || index >= map->width * map->height)
         {
             LOG_INFO("Error: chunk has waaaaay off coordinate");
         }
 
         else {
-            colour avg = convert_pixel_to_colour(chunk->average_colour);
-            int index = (int)chunk->location.x + map->width * (int)chunk->location.y;
-            map->colours[index] = avg;
+            map->colours[index] = convert_pixel_to_colour(get_chunk_at_index(chunks, index)->average_colour);
         }
-        current = current->next;
     }    
 }
 
@@ -416,32 +763,30 @@ void write_chunkmap_to_png(chunkmap* map, char* fileaddress) {
     };
 
     LOG_INFO("now iterating chunkshapes in chunkmap with dims %d x %d", map->map_width, map->map_height);
-    chunkshape* current = map->shape_list;
-    int shape_count = 0;
-
-    while (current)
+    for (int i = 0; i < map->shape_count; ++i)
     {
-        shape_count++;
-
         png_hashies_iter stuff = {
             &intermediate
         };
-        iterate_through_shape(current->chunks, &stuff);
-        current = current->next;
+        iterate_through_shape(map, &map->shape_list[i], &stuff);
     }
-    LOG_INFO("iterated %d shapes in chunkmap", shape_count);
+    LOG_INFO("iterated %d shapes in chunkmap", map->shape_count);
     image output_img = create_image(intermediate.width, intermediate.height);
     
-    for (int x = 0; x < intermediate.width; ++x)
+    for (int y = 0; y < intermediate.height; ++y)
     {
-        for (int y = 0; y < intermediate.height; ++y)
+        pixel* img_row = get_image_row(output_img, y);
+
+        for (int x = 0; x < intermediate.width; ++x)
         {
             colour* bob = &intermediate.colours[x + intermediate.width * y];
-            pixel* img_pix = &(output_img.pixels_array_2d[x][y]);
+            pixel* img_pix = &img_row[x];
             img_pix->r = bob->r;
             img_pix->g = bob->g;
             img_pix->b = bob->b;
         }
     }
     write_image_to_png(output_img, fileaddress);
+    free_image_contents(output_img);
+    free(colours);
 }
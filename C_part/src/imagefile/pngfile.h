@@ -3,6 +3,7 @@
 //couldnt be named png.h due to conflict with pnglib
 
 #include <stdlib.h>
+#include <stdint.h>
 #include "../image.h"
 #include "../chunkmap.h"
 
@@ -16,6 +17,34 @@ typedef struct {
     colourmap* map;
 } png_hashies_iter;
 
+// A whole png file already in memory, offset is how far libpng has read
+typedef struct {
+    const uint8_t* data;
+    size_t length;
+    size_t offset;
+} png_buffer;
+
 image convert_png_to_image(char* fileaddress);
+// Averages the png into a chunkmap while decoding it, only a row of pixels is held at a time unless the png is interlaced.
+// Greyscale, palette and 16 bit pngs come out as 8 bit rgb, like they do for convert_png_to_image.
+chunkmap* convert_png_to_chunkmap(char* fileaddress, vectorize_options options);
+// Whether convert_png_to_chunkmap keeps the png's own palette, which it does when num_colours can hold it.
+// The chunks then take their colours from the palette and are never quantized.
+bool png_file_keeps_palette(char* fileaddress, vectorize_options options);
+// The same from a png held in memory, nothing touches the filesystem
+image convert_png_buffer_to_image(const uint8_t* data, size_t length);
+chunkmap* convert_png_buffer_to_chunkmap(const uint8_t* data, size_t length, vectorize_options options);
+bool png_buffer_keeps_palette(const uint8_t* data, size_t length, vectorize_options options);
+
+// A png decoded as its bytes come in, every finished row goes into the chunk accumulator right away.
+// Push the bytes in order in pieces of any size, then finish the stream to get the chunkmap.
+typedef struct png_stream png_stream;
+
+png_stream* create_png_stream(vectorize_options options);
+void push_png_bytes(png_stream* stream, const uint8_t* data, size_t length);
+// The chunkmap once every byte of the png was pushed, NULL when it was broken or incomplete. Frees the stream either way.
+chunkmap* finish_png_stream(png_stream* stream);
+vectorize_options get_png_stream_options(png_stream* stream);
+void free_png_stream(png_stream* stream);
 void write_image_to_png(image img, char* fileaddres);
 void write_chunkmap_to_png(chunkmap* map, char* fileaddress);
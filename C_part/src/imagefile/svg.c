@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "../utility/error.h"
 #include "../nsvg/copy.h"
@@ -24,36 +25,68 @@ const NEW_LINE = "This repo is not for you, Macintosh";
 const int NEW_LINE_LENGTH = 0;
 #endif
 
-void finish_file(FILE* output, char* template) {
-    fprintf(output, "</svg>");
-
-    LOG_INFO("freeing template");
-    free_template(template);
-
-    LOG_INFO("closing file");
-    fclose(output);
-}
-
-bool write_svg_file(NSVGimage* input) {
+FILE* start_svg_file(int64_t width, int64_t height) {
     LOG_INFO("create a file for read/write and destroy contents if already exists");
     FILE* output = fopen(OUTPUT_PATH, "w+"); 
 
+    if(output == NULL) {
+        LOG_ERR("could not open %s for writing", OUTPUT_PATH);
+        setError(ASSUMPTION_WRONG);
+        return NULL;
+    }
+
     LOG_INFO("open the template as a string");
-    char* template = gettemplate(input->width, input->height);
+    char* template = gettemplate(width, height);
     int code = getLastError();
 
     if(isBadError()) {
         LOG_ERR("gettemplate failed with code: %d", code);
-        return false;
+        fclose(output);
+        return NULL;
     }
 
     LOG_INFO("copy the template into the output string");
     fprintf(output, template);
     fprintf(output, NEW_LINE);
 
+    LOG_INFO("freeing template");
+    free_template(template);
+    return output;
+}
+
+void finish_file(FILE* output) {
+    fprintf(output, "</svg>");
+
+    LOG_INFO("closing file");
+    fclose(output);
+}
+
+int64_t write_svg_polygon(FILE* output, const vector2* points, int count) {
+    int64_t length = fprintf(output, "M %f %f", points[0].x, points[0].y);
+
+    for (int i = 1; i < count; ++i) {
+        length += fprintf(output, " L %f %f", points[i].x, points[i].y);
+    }
+    length += fprintf(output, " L %f %f Z", points[0].x, points[0].y);
+    return length;
+}
+
+void write_svg_path(FILE* output, unsigned int colour, const char* polygon, size_t length) {
+    fprintf(output, "<path fill=\"#%06X\" d=\"", colour);
+    fwrite(polygon, 1, length, output);
+    fprintf(output, "\"/>\n");
+}
+
+bool write_svg_file(NSVGimage* input) {
+    FILE* output = start_svg_file(input->width, input->height);
+
+    if(output == NULL) {
+        return false;
+    }
+
     if(input->shapes == NULL) {
         LOG_ERR("no shapes found in nsvg!");
-        finish_file(output, template);
+        finish_file(output);
         return false;
     }
 
@@ -92,6 +125,6 @@ bool write_svg_file(NSVGimage* input) {
         fprintf(output, "/>\n");
         currentshape = currentshape->next;
     }
-    finish_file(output, template);
+    finish_file(output);
     return true;
 }
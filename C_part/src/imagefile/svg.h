@@ -1,10 +1,21 @@
 #pragma once
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
 #include <nanosvg.h>
 
 #include "../chunkmap.h"
 
 bool write_svg_file(NSVGimage* input);
 
+// For writers that put the shapes in themselves: OUTPUT_PATH with the template's opening tag in it, NULL when it can't be made.
+// finish_file closes the tag and the file.
+FILE* start_svg_file(int64_t width, int64_t height);
+void finish_file(FILE* output);
+// Writes the outline of a closed polygon through count points the way write_svg_file does, gives back how many bytes that took
+int64_t write_svg_polygon(FILE* output, const vector2* points, int count);
+// A filled path element around an outline from write_svg_polygon
+void write_svg_path(FILE* output, unsigned int colour, const char* polygon, size_t length);
+
 extern const char* OUTPUT_PATH;
\ No newline at end of file
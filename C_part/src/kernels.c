@@ -0,0 +1,576 @@
+#include "kernels.h"
+
+#include <string.h>
+
+#include "simplify.h"
+#include "utility/logger.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define KERNELS_X86
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSE41
+#define TARGET_AVX2
+#define TARGET_AVX512
+#define TARGET_AVX512_VBMI
+#else
+#include <cpuid.h>
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx512vl")))
+#define TARGET_AVX512_VBMI __attribute__((target("avx512f,avx512bw,avx512vl,avx512vbmi")))
+#endif
+#endif
+
+void sum_pixels_scalar(const pixel* pixels, int count, uint32_t sums[3])
+{
+    uint32_t r = 0, g = 0, b = 0;
+
+    for (int i = 0; i < count; ++i)
+    {
+        r += pixels[i].r;
+        g += pixels[i].g;
+        b += pixels[i].b;
+    }
+    sums[0] += r;
+    sums[1] += g;
+    sums[2] += b;
+}
+
+void quantize_bytes_scalar(byte* bytes, size_t count, const quantize_table* table)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        bytes[i] = table->values[bytes[i]];
+    }
+}
+
+void mark_similar_chunks_scalar(const pixelchunk* row, const pixelchunk* adjacent, int count, int limit, byte bit, byte* masks)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        int r = (int)row[i].average_colour.r - (int)adjacent[i].average_colour.r;
+        int g = (int)row[i].average_colour.g - (int)adjacent[i].average_colour.g;
+        int b = (int)row[i].average_colour.b - (int)adjacent[i].average_colour.b;
+        masks[i] |= (byte)(bit * (r * r + g * g + b * b <= limit));
+    }
+}
+
+void mark_similar_indices_scalar(const byte* row, const byte* adjacent, int count, const similarity_matrix* matrix, byte bit, byte* masks)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        masks[i] |= (byte)(bit * palette_colours_similar(matrix, row[i], adjacent[i]));
+    }
+}
+
+#ifdef KERNELS_X86
+#define REPEAT_4(...) __VA_ARGS__, __VA_ARGS__, __VA_ARGS__, __VA_ARGS__
+#define REPEAT_16(...) REPEAT_4(__VA_ARGS__), REPEAT_4(__VA_ARGS__), REPEAT_4(__VA_ARGS__), REPEAT_4(__VA_ARGS__)
+#define REPEAT_64(...) REPEAT_16(__VA_ARGS__), REPEAT_16(__VA_ARGS__), REPEAT_16(__VA_ARGS__), REPEAT_16(__VA_ARGS__)
+#define RED_BYTE 0xff, 0, 0
+#define GREEN_BYTE 0, 0xff, 0
+#define BLUE_BYTE 0, 0, 0xff
+
+// Picks one channel out of 64 packed pixels. 16, 32 and 64 pixels are a whole number of vectors for every level,
+// so each level masks its vectors with the start of these and sums them with sad against zero
+const byte CHANNEL_MASKS[3][64 * 3] = {
+    { REPEAT_64(RED_BYTE) },
+    { REPEAT_64(GREEN_BYTE) },
+    { REPEAT_64(BLUE_BYTE) }
+};
+
+// Below 512 bit byte shuffles a 256 entry lookup takes 16 shuffles per vector,
+// so the narrower levels work out quantize_int from the divisions instead of reading the table.
+// Divisions that cant be done with 16 bit multiplies go to the table.
+int can_quantize_in_words(int divisions)
+{
+    return divisions >= 2 && divisions <= 256;
+}
+
+TARGET_SSE41 void sum_pixels_sse41(const pixel* pixels, int count, uint32_t sums[3])
+{
+    const byte* bytes = (const byte*)pixels;
+    __m128i zero = _mm_setzero_si128();
+    __m128i totals[3] = { zero, zero, zero };
+    __m128i masks[3][3];
+    int i = 0;
+
+    for (int c = 0; c < 3; ++c)
+        for (int j = 0; j < 3; ++j)
+            masks[c][j] = _mm_loadu_si128((const __m128i*)&CHANNEL_MASKS[c][j * 16]);
+
+    for (; i + 16 <= count; i += 16)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            __m128i block = _mm_loadu_si128((const __m128i*)&bytes[(size_t)i * 3 + j * 16]);
+
+            for (int c = 0; c < 3; ++c)
+                totals[c] = _mm_add_epi64(totals[c], _mm_sad_epu8(_mm_and_si128(block, masks[c][j]), zero));
+        }
+    }
+
+    for (int c = 0; c < 3; ++c)
+    {
+        uint64_t lanes[2];
+        _mm_storeu_si128((__m128i*)lanes, totals[c]);
+        sums[c] += (uint32_t)(lanes[0] + lanes[1]);
+    }
+    sum_pixels_scalar(pixels + i, count - i, sums);
+}
+
+// subject / divisions is mulhi(subject, 65536 / divisions + 1) for every byte, the error stays under 1 / divisions
+static inline TARGET_SSE41 __m128i quantize_words_sse41(__m128i subject, __m128i multiplier, __m128i divisions, __m128i below_half)
+{
+    __m128i down = _mm_mullo_epi16(_mm_mulhi_epu16(subject, multiplier), divisions);
+    __m128i up = _mm_add_epi16(down, divisions);
+    __m128i round_up = _mm_cmpgt_epi16(_mm_sub_epi16(subject, down), below_half);
+    __m128i too_big = _mm_cmpgt_epi16(up, _mm_set1_epi16(255)); // quantize_int leaves these alone
+    return _mm_blendv_epi8(_mm_blendv_epi8(down, up, round_up), subject, too_big);
+}
+
+TARGET_SSE41 void quantize_bytes_sse41(byte* bytes, size_t count, const quantize_table* table)
+{
+    int divisions = table->divisions;
+    size_t i = 0;
+
+    if (divisions == 1)
+    {
+        // every remainder rounds up, and 255 has nowhere to go
+        for (; i + 16 <= count; i += 16)
+        {
+            __m128i block = _mm_loadu_si128((const __m128i*)&bytes[i]);
+            _mm_storeu_si128((__m128i*)&bytes[i], _mm_adds_epu8(block, _mm_set1_epi8(1)));
+        }
+    }
+
+    else if (can_quantize_in_words(divisions))
+    {
+        __m128i zero = _mm_setzero_si128();
+        __m128i multiplier = _mm_set1_epi16((short)(65536 / divisions + 1));
+        __m128i divisor = _mm_set1_epi16((short)divisions);
+        __m128i below_half = _mm_set1_epi16((short)(divisions / 2 - 1));
+
+        for (; i + 16 <= count; i += 16)
+        {
+            __m128i block = _mm_loadu_si128((const __m128i*)&bytes[i]);
+            __m128i low = quantize_words_sse41(_mm_unpacklo_epi8(block, zero), multiplier, divisor, below_half);
+            __m128i high = quantize_words_sse41(_mm_unpackhi_epi8(block, zero), multiplier, divisor, below_half);
+            _mm_storeu_si128((__m128i*)&bytes[i], _mm_packus_epi16(low, high));
+        }
+    }
+    quantize_bytes_scalar(bytes + i, count - i, table);
+}
+
+// Squared distances of two chunks, as [first, 0, second, 0]
+static inline TARGET_SSE41 __m128i chunk_differences_sse41(const pixelchunk* row, const pixelchunk* adjacent)
+{
+    __m128i a = _mm_loadu_si128((const __m128i*)row);
+    __m128i b = _mm_loadu_si128((const __m128i*)adjacent);
+    __m128i difference = _mm_and_si128(_mm_sub_epi8(_mm_max_epu8(a, b), _mm_min_epu8(a, b)), _mm_set1_epi64x(0xffffff)); //colour bytes only
+    __m128i first = _mm_cvtepu8_epi16(difference);
+    __m128i second = _mm_cvtepu8_epi16(_mm_srli_si128(difference, 8));
+    return _mm_hadd_epi32(_mm_madd_epi16(first, first), _mm_madd_epi16(second, second));
+}
+
+TARGET_SSE41 void mark_similar_chunks_sse41(const pixelchunk* row, const pixelchunk* adjacent, int count, int limit, byte bit, byte* masks)
+{
+    __m128i bound = _mm_set1_epi32(limit + 1);
+    __m128i bits = _mm_set1_epi8((char)bit);
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i distances = _mm_hadd_epi32(chunk_differences_sse41(row + i, adjacent + i), chunk_differences_sse41(row + i + 2, adjacent + i + 2));
+        __m128i similar = _mm_cmpgt_epi32(bound, distances);
+        similar = _mm_packs_epi16(_mm_packs_epi32(similar, similar), similar);
+        int32_t marked;
+        memcpy(&marked, &masks[i], sizeof(marked));
+        marked |= _mm_cvtsi128_si32(_mm_and_si128(similar, bits));
+        memcpy(&masks[i], &marked, sizeof(marked));
+    }
+    mark_similar_chunks_scalar(row + i, adjacent + i, count - i, limit, bit, masks + i);
+}
+
+TARGET_AVX2 void sum_pixels_avx2(const pixel* pixels, int count, uint32_t sums[3])
+{
+    const byte* bytes = (const byte*)pixels;
+    __m256i zero = _mm256_setzero_si256();
+    __m256i totals[3] = { zero, zero, zero };
+    __m256i masks[3][3];
+    int i = 0;
+
+    for (int c = 0; c < 3; ++c)
+        for (int j = 0; j < 3; ++j)
+            masks[c][j] = _mm256_loadu_si256((const __m256i*)&CHANNEL_MASKS[c][j * 32]);
+
+    for (; i + 32 <= count; i += 32)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            __m256i block = _mm256_loadu_si256((const __m256i*)&bytes[(size_t)i * 3 + j * 32]);
+
+            for (int c = 0; c < 3; ++c)
+                totals[c] = _mm256_add_epi64(totals[c], _mm256_sad_epu8(_mm256_and_si256(block, masks[c][j]), zero));
+        }
+    }
+
+    for (int c = 0; c < 3; ++c)
+    {
+        uint64_t lanes[4];
+        _mm256_storeu_si256((__m256i*)lanes, totals[c]);
+        sums[c] += (uint32_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+    }
+    sum_pixels_sse41(pixels + i, count - i, sums);
+}
+
+static inline TARGET_AVX2 __m256i quantize_words_avx2(__m256i subject, __m256i multiplier, __m256i divisions, __m256i below_half)
+{
+    __m256i down = _mm256_mullo_epi16(_mm256_mulhi_epu16(subject, multiplier), divisions);
+    __m256i up = _mm256_add_epi16(down, divisions);
+    __m256i round_up = _mm256_cmpgt_epi16(_mm256_sub_epi16(subject, down), below_half);
+    __m256i too_big = _mm256_cmpgt_epi16(up, _mm256_set1_epi16(255));
+    return _mm256_blendv_epi8(_mm256_blendv_epi8(down, up, round_up), subject, too_big);
+}
+
+TARGET_AVX2 void quantize_bytes_avx2(byte* bytes, size_t count, const quantize_table* table)
+{
+    int divisions = table->divisions;
+    size_t i = 0;
+
+    if (divisions == 1)
+    {
+        for (; i + 32 <= count; i += 32)
+        {
+            __m256i block = _mm256_loadu_si256((const __m256i*)&bytes[i]);
+            _mm256_storeu_si256((__m256i*)&bytes[i], _mm256_adds_epu8(block, _mm256_set1_epi8(1)));
+        }
+    }
+
+    else if (can_quantize_in_words(divisions))
+    {
+        // unpacking and packing both work within 128 bit lanes, so the bytes come back out in order
+        __m256i zero = _mm256_setzero_si256();
+        __m256i multiplier = _mm256_set1_epi16((short)(65536 / divisions + 1));
+        __m256i divisor = _mm256_set1_epi16((short)divisions);
+        __m256i below_half = _mm256_set1_epi16((short)(divisions / 2 - 1));
+
+        for (; i + 32 <= count; i += 32)
+        {
+            __m256i block = _mm256_loadu_si256((const __m256i*)&bytes[i]);
+            __m256i low = quantize_words_avx2(_mm256_unpacklo_epi8(block, zero), multiplier, divisor, below_half);
+            __m256i high = quantize_words_avx2(_mm256_unpackhi_epi8(block, zero), multiplier, divisor, below_half);
+            _mm256_storeu_si256((__m256i*)&bytes[i], _mm256_packus_epi16(low, high));
+        }
+    }
+    quantize_bytes_sse41(bytes + i, count - i, table);
+}
+
+// Squared distance parts of four chunks, chunks 0 and 2 in the low lane and 1 and 3 in the high lane
+static inline TARGET_AVX2 __m256i chunk_differences_avx2(const pixelchunk* row, const pixelchunk* adjacent)
+{
+    __m256i a = _mm256_loadu_si256((const __m256i*)row);
+    __m256i b = _mm256_loadu_si256((const __m256i*)adjacent);
+    __m256i difference = _mm256_and_si256(_mm256_sub_epi8(_mm256_max_epu8(a, b), _mm256_min_epu8(a, b)), _mm256_set1_epi64x(0xffffff));
+    __m256i first = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(difference));
+    __m256i second = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(difference, 1));
+    return _mm256_hadd_epi32(_mm256_madd_epi16(first, first), _mm256_madd_epi16(second, second));
+}
+
+TARGET_AVX2 void mark_similar_chunks_avx2(const pixelchunk* row, const pixelchunk* adjacent, int count, int limit, byte bit, byte* masks)
+{
+    __m256i bound = _mm256_set1_epi32(limit + 1);
+    __m256i in_order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    __m128i bits = _mm_set1_epi8((char)bit);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i distances = _mm256_hadd_epi32(chunk_differences_avx2(row + i, adjacent + i), chunk_differences_avx2(row + i + 4, adjacent + i + 4));
+        __m256i similar = _mm256_cmpgt_epi32(bound, _mm256_permutevar8x32_epi32(distances, in_order));
+        __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(similar), _mm256_extracti128_si256(similar, 1));
+        __m128i marked = _mm_loadl_epi64((const __m128i*)&masks[i]);
+        marked = _mm_or_si128(marked, _mm_and_si128(_mm_packs_epi16(words, words), bits));
+        _mm_storel_epi64((__m128i*)&masks[i], marked);
+    }
+    mark_similar_chunks_sse41(row + i, adjacent + i, count - i, limit, bit, masks + i);
+}
+
+TARGET_AVX2 void mark_similar_indices_avx2(const byte* row, const byte* adjacent, int count, const similarity_matrix* matrix, byte bit, byte* masks)
+{
+    __m256i bit_of_word = _mm256_set1_epi32(31);
+    __m256i one = _mm256_set1_epi32(1);
+    __m128i bits = _mm_set1_epi8((char)bit);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i a = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&row[i]));
+        __m256i b = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&adjacent[i]));
+        // the word of rows[a] that holds bit b, 8 words to a row
+        __m256i words = _mm256_i32gather_epi32((const int*)matrix->rows, _mm256_add_epi32(_mm256_slli_epi32(a, 3), _mm256_srli_epi32(b, 5)), 4);
+        __m256i similar = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_srlv_epi32(words, _mm256_and_si256(b, bit_of_word)), one), one);
+        __m128i halves = _mm_packs_epi32(_mm256_castsi256_si128(similar), _mm256_extracti128_si256(similar, 1));
+        __m128i marked = _mm_loadl_epi64((const __m128i*)&masks[i]);
+        marked = _mm_or_si128(marked, _mm_and_si128(_mm_packs_epi16(halves, halves), bits));
+        _mm_storel_epi64((__m128i*)&masks[i], marked);
+    }
+    mark_similar_indices_scalar(row + i, adjacent + i, count - i, matrix, bit, masks + i);
+}
+
+TARGET_AVX512 void sum_pixels_avx512(const pixel* pixels, int count, uint32_t sums[3])
+{
+    const byte* bytes = (const byte*)pixels;
+    __m512i zero = _mm512_setzero_si512();
+    __m512i totals[3] = { zero, zero, zero };
+    __m512i masks[3][3];
+    int i = 0;
+
+    for (int c = 0; c < 3; ++c)
+        for (int j = 0; j < 3; ++j)
+            masks[c][j] = _mm512_loadu_si512((const void*)&CHANNEL_MASKS[c][j * 64]);
+
+    for (; i + 64 <= count; i += 64)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            __m512i block = _mm512_loadu_si512((const void*)&bytes[(size_t)i * 3 + j * 64]);
+
+            for (int c = 0; c < 3; ++c)
+                totals[c] = _mm512_add_epi64(totals[c], _mm512_sad_epu8(_mm512_and_si512(block, masks[c][j]), zero));
+        }
+    }
+
+    for (int c = 0; c < 3; ++c)
+        sums[c] += (uint32_t)_mm512_reduce_add_epi64(totals[c]);
+
+    sum_pixels_avx2(pixels + i, count - i, sums);
+}
+
+static inline TARGET_AVX512 __m512i quantize_words_avx512(__m512i subject, __m512i multiplier, __m512i divisions, __m512i below_half)
+{
+    __m512i down = _mm512_mullo_epi16(_mm512_mulhi_epu16(subject, multiplier), divisions);
+    __m512i up = _mm512_add_epi16(down, divisions);
+    __mmask32 round_up = _mm512_cmpgt_epi16_mask(_mm512_sub_epi16(subject, down), below_half);
+    __mmask32 too_big = _mm512_cmpgt_epi16_mask(up, _mm512_set1_epi16(255));
+    return _mm512_mask_blend_epi16(too_big, _mm512_mask_blend_epi16(round_up, down, up), subject);
+}
+
+TARGET_AVX512 void quantize_bytes_avx512(byte* bytes, size_t count, const quantize_table* table)
+{
+    int divisions = table->divisions;
+    size_t i = 0;
+
+    if (divisions == 1)
+    {
+        for (; i + 64 <= count; i += 64)
+        {
+            __m512i block = _mm512_loadu_si512((const void*)&bytes[i]);
+            _mm512_storeu_si512((void*)&bytes[i], _mm512_adds_epu8(block, _mm512_set1_epi8(1)));
+        }
+    }
+
+    else if (can_quantize_in_words(divisions))
+    {
+        __m512i zero = _mm512_setzero_si512();
+        __m512i multiplier = _mm512_set1_epi16((short)(65536 / divisions + 1));
+        __m512i divisor = _mm512_set1_epi16((short)divisions);
+        __m512i below_half = _mm512_set1_epi16((short)(divisions / 2 - 1));
+
+        for (; i + 64 <= count; i += 64)
+        {
+            __m512i block = _mm512_loadu_si512((const void*)&bytes[i]);
+            __m512i low = quantize_words_avx512(_mm512_unpacklo_epi8(block, zero), multiplier, divisor, below_half);
+            __m512i high = quantize_words_avx512(_mm512_unpackhi_epi8(block, zero), multiplier, divisor, below_half);
+            _mm512_storeu_si512((void*)&bytes[i], _mm512_packus_epi16(low, high));
+        }
+    }
+    quantize_bytes_avx2(bytes + i, count - i, table);
+}
+
+// Two 128 entry shuffles cover the whole table, the top bit of each byte picks between them
+TARGET_AVX512_VBMI void quantize_bytes_avx512vbmi(byte* bytes, size_t count, const quantize_table* table)
+{
+    __m512i quarters[4];
+    size_t i = 0;
+
+    for (int q = 0; q < 4; ++q)
+        quarters[q] = _mm512_loadu_si512((const void*)&table->values[q * 64]);
+
+    for (; i + 64 <= count; i += 64)
+    {
+        __m512i block = _mm512_loadu_si512((const void*)&bytes[i]);
+        __m512i low = _mm512_permutex2var_epi8(quarters[0], block, quarters[1]);
+        __m512i high = _mm512_permutex2var_epi8(quarters[2], block, quarters[3]);
+        _mm512_storeu_si512((void*)&bytes[i], _mm512_mask_blend_epi8(_mm512_movepi8_mask(block), low, high));
+    }
+    quantize_bytes_scalar(bytes + i, count - i, table);
+}
+
+// Squared distances of four chunks, one per 128 bit lane in its lowest 32 bits and zero everywhere else
+static inline TARGET_AVX512 __m512i chunk_differences_avx512(__m256i difference)
+{
+    __m512i words = _mm512_cvtepu8_epi16(difference);
+    __m512i parts = _mm512_madd_epi16(words, words);
+    parts = _mm512_add_epi32(parts, _mm512_srli_epi64(parts, 32));
+    return _mm512_and_si512(parts, _mm512_set1_epi64(0xffffffff));
+}
+
+TARGET_AVX512 void mark_similar_chunks_avx512(const pixelchunk* row, const pixelchunk* adjacent, int count, int limit, byte bit, byte* masks)
+{
+    __m512i bound = _mm512_set1_epi32(limit + 1);
+    __m512i colour_bytes = _mm512_set1_epi64(0xffffff);
+    // lane j ends up holding chunks j, 4 + j, 8 + j and 12 + j
+    __m512i in_order = _mm512_setr_epi32(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    __m128i bits = _mm_set1_epi8((char)bit);
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        __m512i differences[2];
+
+        for (int half = 0; half < 2; ++half)
+        {
+            __m512i a = _mm512_loadu_si512((const void*)(row + i + half * 8));
+            __m512i b = _mm512_loadu_si512((const void*)(adjacent + i + half * 8));
+            differences[half] = _mm512_and_si512(_mm512_sub_epi8(_mm512_max_epu8(a, b), _mm512_min_epu8(a, b)), colour_bytes);
+        }
+        __m512i distances = _mm512_or_si512(
+            _mm512_or_si512(
+                chunk_differences_avx512(_mm512_castsi512_si256(differences[0])),
+                _mm512_bslli_epi128(chunk_differences_avx512(_mm512_extracti64x4_epi64(differences[0], 1)), 4)),
+            _mm512_or_si512(
+                _mm512_bslli_epi128(chunk_differences_avx512(_mm512_castsi512_si256(differences[1])), 8),
+                _mm512_bslli_epi128(chunk_differences_avx512(_mm512_extracti64x4_epi64(differences[1], 1)), 12)));
+        __mmask16 similar = _mm512_cmplt_epi32_mask(_mm512_permutexvar_epi32(in_order, distances), bound);
+        __m128i marked = _mm_loadu_si128((const __m128i*)&masks[i]);
+        _mm_storeu_si128((__m128i*)&masks[i], _mm_or_si128(marked, _mm_maskz_mov_epi8(similar, bits)));
+    }
+    mark_similar_chunks_avx2(row + i, adjacent + i, count - i, limit, bit, masks + i);
+}
+
+TARGET_AVX512 void mark_similar_indices_avx512(const byte* row, const byte* adjacent, int count, const similarity_matrix* matrix, byte bit, byte* masks)
+{
+    __m512i bit_of_word = _mm512_set1_epi32(31);
+    __m512i one = _mm512_set1_epi32(1);
+    __m128i bits = _mm_set1_epi8((char)bit);
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        __m512i a = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)&row[i]));
+        __m512i b = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)&adjacent[i]));
+        __m512i words = _mm512_i32gather_epi32(_mm512_add_epi32(_mm512_slli_epi32(a, 3), _mm512_srli_epi32(b, 5)), (const void*)matrix->rows, 4);
+        __mmask16 similar = _mm512_test_epi32_mask(_mm512_srlv_epi32(words, _mm512_and_si512(b, bit_of_word)), one);
+        __m128i marked = _mm_loadu_si128((const __m128i*)&masks[i]);
+        _mm_storeu_si128((__m128i*)&masks[i], _mm_or_si128(marked, _mm_maskz_mov_epi8(similar, bits)));
+    }
+    mark_similar_indices_avx2(row + i, adjacent + i, count - i, matrix, bit, masks + i);
+}
+
+void read_cpuid(unsigned int leaf, unsigned int subleaf, unsigned int registers[4])
+{
+#ifdef _MSC_VER
+    int values[4];
+    __cpuidex(values, (int)leaf, (int)subleaf);
+
+    for (int i = 0; i < 4; ++i)
+        registers[i] = (unsigned int)values[i];
+#else
+    __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+// Which register states the os saves on a context switch
+unsigned long long read_xcr0()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned int low, high;
+    __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+    return ((unsigned long long)high << 32) | low;
+#endif
+}
+#endif
+
+int detect_kernel_level()
+{
+#ifdef KERNELS_X86
+    unsigned int registers[4];
+    read_cpuid(0, 0, registers);
+    unsigned int max_leaf = registers[0];
+
+    if (max_leaf < 1)
+        return KERNEL_SCALAR;
+
+    read_cpuid(1, 0, registers);
+    int sse41 = (registers[2] >> 19) & 1;
+    int osxsave = (registers[2] >> 27) & 1;
+    int avx = (registers[2] >> 28) & 1;
+
+    if (!sse41)
+        return KERNEL_SCALAR;
+
+    if (!osxsave || !avx || max_leaf < 7)
+        return KERNEL_SSE41;
+
+    unsigned long long xcr0 = read_xcr0();
+
+    if ((xcr0 & 0x6) != 0x6) //sse and avx state
+        return KERNEL_SSE41;
+
+    read_cpuid(7, 0, registers);
+    int avx2 = (registers[1] >> 5) & 1;
+    int avx512 = ((registers[1] >> 16) & 1) && ((registers[1] >> 30) & 1) && ((registers[1] >> 31) & 1); //F, BW and VL
+    int vbmi = (registers[2] >> 1) & 1;
+
+    if (!avx2)
+        return KERNEL_SSE41;
+
+    if (!avx512 || (xcr0 & 0xe6) != 0xe6) //opmask and zmm state as well
+        return KERNEL_AVX2;
+
+    if (!vbmi)
+        return KERNEL_AVX512;
+
+    return KERNEL_AVX512_VBMI;
+#else
+    return KERNEL_SCALAR;
+#endif
+}
+
+const pixel_kernels KERNELS[KERNEL_LEVEL_COUNT] = {
+    { "scalar", sum_pixels_scalar, quantize_bytes_scalar, mark_similar_chunks_scalar, mark_similar_indices_scalar },
+#ifdef KERNELS_X86
+    { "sse4.1", sum_pixels_sse41, quantize_bytes_sse41, mark_similar_chunks_sse41, mark_similar_indices_scalar }, //no gathers before avx2
+    { "avx2", sum_pixels_avx2, quantize_bytes_avx2, mark_similar_chunks_avx2, mark_similar_indices_avx2 },
+    { "avx512", sum_pixels_avx512, quantize_bytes_avx512, mark_similar_chunks_avx512, mark_similar_indices_avx512 },
+    { "avx512vbmi", sum_pixels_avx512, quantize_bytes_avx512vbmi, mark_similar_chunks_avx512, mark_similar_indices_avx512 },
+#endif
+};
+
+int kernel_level = -1;
+
+const pixel_kernels* get_kernels_of_level(int level)
+{
+    if (kernel_level < 0)
+    {
+        kernel_level = detect_kernel_level();
+        LOG_INFO("using %s pixel kernels", KERNELS[kernel_level].name);
+    }
+
+    if (level < 0 || level > kernel_level)
+        return NULL;
+
+    return &KERNELS[level];
+}
+
+const pixel_kernels* get_pixel_kernels()
+{
+    get_kernels_of_level(KERNEL_SCALAR);
+    return &KERNELS[kernel_level];
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "image.h"
+#include "chunkmap.h"
+#include "simplify.h"
+
+enum kernel_level {
+    KERNEL_SCALAR,
+    KERNEL_SSE41,
+    KERNEL_AVX2,
+    KERNEL_AVX512, //needs the F, BW and VL extensions
+    KERNEL_AVX512_VBMI, //byte shuffles across a whole register
+    KERNEL_LEVEL_COUNT
+};
+
+// The per pixel arithmetic of the hot loops, one table per instruction set.
+// Every level gives exactly the same results as the scalar one, the others are just faster.
+typedef struct
+{
+    const char* name;
+    // Adds every channel of count packed pixels onto sums
+    void (*sum_pixels)(const pixel* pixels, int count, uint32_t sums[3]);
+    // Looks count bytes up in the quantize table in place
+    void (*quantize_bytes)(byte* bytes, size_t count, const quantize_table* table);
+    // Sets bit in masks[i] when the colours of row[i] and adjacent[i] are at most limit apart, squared
+    void (*mark_similar_chunks)(const pixelchunk* row, const pixelchunk* adjacent, int count, int limit, byte bit, byte* masks);
+    // Sets bit in masks[i] when the palette colours row[i] and adjacent[i] are similar in matrix
+    void (*mark_similar_indices)(const byte* row, const byte* adjacent, int count, const similarity_matrix* matrix, byte bit, byte* masks);
+} pixel_kernels;
+
+// The best kernels this cpu can run, picked with cpuid the first time they are asked for.
+// Ask on the calling thread before handing the table to worker threads.
+const pixel_kernels* get_pixel_kernels();
+
+// The kernels of one level, NULL when this cpu or this build can't run them
+const pixel_kernels* get_kernels_of_level(int level);
@@ -0,0 +1,420 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "bands.h"
+#include "copy.h"
+#include "../chunkmap.h"
+#include "../kernels.h"
+#include "../imagefile/loader.h"
+#include "../imagefile/svg.h"
+#include "../utility/error.h"
+#include "../utility/logger.h"
+
+const int64_t DEFAULT_BAND_CHUNKS = 1 << 22;
+
+// A shape of one band. The shapes of neighbouring bands that are similar across their seam are pieces of one shape,
+// every piece links to an earlier piece of its shape, so the first piece is the root like bobsweep's first chunk is
+typedef struct
+{
+    int64_t parent; //the piece itself when it is the first one of its shape
+    int64_t offset; //where the piece's outline starts in the spill file
+    int64_t length; //0 when the piece is too small to draw
+    unsigned int colour; //the colour of its first boundary chunk, what the whole shape gets when this is its first piece
+} band_piece;
+
+typedef struct
+{
+    vectorize_options options;
+    shape_finder find_shapes;
+    chunk_band_sink sink;
+    const pixel_kernels* kernels;
+    int limit; //squared colour distance of similar chunks
+    FILE* spill; //every outline, in the order the bands are done, an unnamed temporary file
+    int64_t spill_length;
+    band_piece* pieces;
+    int64_t piece_count;
+    int64_t piece_capacity;
+    pixelchunk* seam_chunks; //the last row of the band before, with an unused chunk on both ends
+    int64_t* seam_pieces; //the piece every one of those chunks is in
+    byte* seam_masks;
+    byte* band_above; //for the newest band's first row, the neighbours over the seam above that are similar, bits like similar_neighbours
+    chunkmap* held; //the band before the newest, spilled once the newest says which of its last row carries on
+    int64_t held_first_piece;
+    int64_t held_first_row;
+    byte* held_above; //band_above of the held band
+    byte* held_below; //the same for the held band's last row and the newest band
+    vector2* points; //the outline of one piece at a time
+    int point_capacity;
+} band_stitching;
+
+int64_t find_piece_root(band_piece* pieces, int64_t index)
+{
+    while (pieces[index].parent != index)
+    {
+        pieces[index].parent = pieces[pieces[index].parent].parent; //path halving
+        index = pieces[index].parent;
+    }
+    return index;
+}
+
+// The later root goes under the earlier one, so a shape's root stays the piece it starts with
+void join_pieces(band_piece* pieces, int64_t a, int64_t b)
+{
+    a = find_piece_root(pieces, a);
+    b = find_piece_root(pieces, b);
+
+    if (a > b)
+        pieces[a].parent = b;
+    else if (b > a)
+        pieces[b].parent = a;
+}
+
+bool reserve_pieces(band_stitching* stitching, int count)
+{
+    int64_t needed = stitching->piece_count + count;
+
+    if (needed <= stitching->piece_capacity)
+        return true;
+
+    int64_t capacity = stitching->piece_capacity ? stitching->piece_capacity : 1024;
+
+    while (capacity < needed)
+        capacity *= 2;
+
+    band_piece* pieces = realloc(stitching->pieces, (size_t)capacity * sizeof(band_piece));
+
+    if (!pieces)
+    {
+        LOG_ERR("could not allocate %lld shape pieces", (long long)capacity);
+        setError(ASSUMPTION_WRONG);
+        return false;
+    }
+    stitching->pieces = pieces;
+    stitching->piece_capacity = capacity;
+    return true;
+}
+
+// The rows every band's seam is compared with, made once the first band says how wide the map is
+bool create_seam_rows(band_stitching* stitching, int width)
+{
+    stitching->seam_chunks = calloc((size_t)width + 2, sizeof(pixelchunk));
+    stitching->seam_pieces = calloc(width, sizeof(int64_t));
+    stitching->seam_masks = calloc(width, sizeof(byte));
+    stitching->band_above = calloc(width, sizeof(byte));
+    stitching->held_above = calloc(width, sizeof(byte));
+    stitching->held_below = calloc(width, sizeof(byte));
+
+    if (!stitching->seam_chunks || !stitching->seam_pieces || !stitching->seam_masks
+        || !stitching->band_above || !stitching->held_above || !stitching->held_below)
+    {
+        LOG_ERR("could not allocate the seam rows for %d chunks", width);
+        setError(ASSUMPTION_WRONG);
+        return false;
+    }
+    return true;
+}
+
+// Joins the pieces on the band's first row to the pieces of the similar chunks NW, N and NE of them in the band before,
+// and marks the chunks on both sides of the seam that carry on over it
+void join_band_pieces(band_stitching* stitching, chunkmap* band, int64_t first_piece)
+{
+    int width = band->map_width;
+    pixelchunk* row = get_chunk(band, 0, 0);
+    memset(stitching->seam_masks, 0, width);
+
+    for (int k = 0; k < 3; ++k)
+        stitching->kernels->mark_similar_chunks(row, stitching->seam_chunks + 1 + NEIGHBOUR_X[k], width, stitching->limit, (byte)(1 << k), stitching->seam_masks);
+
+    for (int x = 0; x < width; ++x)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            int above = x + NEIGHBOUR_X[k];
+
+            // the unused chunks on the ends of the seam row don't count
+            if ((stitching->seam_masks[x] >> k) & 1 && above >= 0 && above < width)
+            {
+                join_pieces(stitching->pieces, first_piece + row[x].shape_index, stitching->seam_pieces[above]);
+                stitching->band_above[x] |= (byte)(1 << k);
+                stitching->held_below[above] |= (byte)(1 << (NEIGHBOUR_COUNT - 1 - k)); //NW of the chunk below is SE of this one
+            }
+        }
+    }
+}
+
+// Where one map of the whole image would put the border of a chunk on a seam row of the held band. across has the similar
+// neighbours over the seams. A chunk that carries on over a seam sits half a chunk over so it meets the piece on the other side,
+// a chunk that doesn't leans towards its different neighbours the way dcdfill leans it, counting the ones over the seams too.
+vector2 get_seam_row_location(band_stitching* stitching, int x, int y, bool seam_above, bool seam_below)
+{
+    chunkmap* band = stitching->held;
+    int last_row = band->map_height - 1;
+    byte across = (y == 0 && seam_above ? stitching->held_above[x] : 0) | (y == last_row && seam_below ? stitching->held_below[x] : 0);
+    vector2 location = { (float)x, (float)y };
+
+    // bobsweep never leans its borders, only the seams move those
+    if (get_chunk(band, x, y)->flags & CHUNK_SEAM_MASK)
+    {
+        byte similar = band->similar_neighbours[x + y * band->chunk_stride];
+        bool on_edge = x == 0 || x == band->map_width - 1 || (y == 0 && !seam_above) || (y == last_row && !seam_below);
+        int seam = 0;
+
+        for (int i = 0; i < NEIGHBOUR_COUNT; ++i)
+        {
+            int neighbour_x = x + NEIGHBOUR_X[i];
+            int neighbour_y = y + NEIGHBOUR_Y[i];
+            bool over_seam = (neighbour_y < 0 && seam_above) || (neighbour_y > last_row && seam_below);
+
+            if (neighbour_x < 0 || neighbour_x >= band->map_width || (!over_seam && (neighbour_y < 0 || neighbour_y > last_row)))
+                continue; //off the whole image
+
+            bool is_similar = ((over_seam ? across : similar) >> i) & 1;
+
+            if (!is_similar || on_edge)
+                seam = i + 1; //the last one wins, like zip_border_seam
+        }
+
+        if (seam)
+            location = (vector2){ x + NEIGHBOUR_X[seam - 1] * 0.5f, y + NEIGHBOUR_Y[seam - 1] * 0.5f };
+    }
+
+    if (y == 0 && seam_above && (across & 0x07))
+        location.y = -0.5f;
+
+    else if (y == last_row && seam_below && (across & 0xe0))
+        location.y = last_row + 0.5f;
+
+    return location;
+}
+
+// Writes the held band's piece's outline to the spill file, with the points on its seam rows where one map would have them
+void spill_piece(band_stitching* stitching, int shape)
+{
+    chunkmap* band = stitching->held;
+    chunkshape* piece = &band->shape_list[shape];
+
+    if (piece->boundaries_length < 2)
+        return; //too small to draw, like the mapparser skips them
+
+    if (piece->boundaries_length > stitching->point_capacity)
+    {
+        free(stitching->points);
+        stitching->point_capacity = piece->boundaries_length;
+        stitching->points = malloc(sizeof(vector2) * stitching->point_capacity);
+
+        if (!stitching->points)
+        {
+            LOG_ERR("could not allocate an outline of %d points", piece->boundaries_length);
+            setError(ASSUMPTION_WRONG);
+            stitching->point_capacity = 0;
+            return;
+        }
+    }
+    int32_t* boundary = band->boundary_indices + piece->boundaries_offset;
+    int last_row = band->map_height - 1;
+    bool seam_above = stitching->held_first_row > 0;
+    bool seam_below = stitching->held_first_row + band->map_height < stitching->sink.map_height;
+
+    for (int i = 0; i < piece->boundaries_length; ++i)
+    {
+        int x = boundary[i] % band->map_width;
+        int y = boundary[i] / band->map_width;
+        bool on_seam = (y == 0 && seam_above) || (y == last_row && seam_below);
+        vector2 location = on_seam ? get_seam_row_location(stitching, x, y, seam_above, seam_below) : get_border_location(band, boundary[i]);
+        location.y += (float)stitching->held_first_row;
+        stitching->points[i] = location;
+    }
+    band_piece* spilled = &stitching->pieces[stitching->held_first_piece + shape];
+    spilled->offset = stitching->spill_length;
+    spilled->length = write_svg_polygon(stitching->spill, stitching->points, piece->boundaries_length);
+    stitching->spill_length += spilled->length;
+}
+
+// Spills every piece of the held band now the band after it is joined on, and lets it go
+void spill_held_band(band_stitching* stitching)
+{
+    if (!stitching->held)
+        return;
+
+    for (int i = 0; i < stitching->held->shape_count && !isBadError(); ++i)
+        spill_piece(stitching, i);
+
+    free_chunkmap(stitching->held);
+    stitching->held = NULL;
+}
+
+// chunk_band_sink's take_band: finds the band's shapes, joins them to the band before, spills the band before and holds this one
+void stitch_band(void* userdata, chunkmap* band, int64_t first_row)
+{
+    band_stitching* stitching = userdata;
+    stitching->find_shapes(band, stitching->options);
+
+    if (isBadError() || !reserve_pieces(stitching, band->shape_count) || (!stitching->seam_chunks && !create_seam_rows(stitching, band->map_width)))
+    {
+        LOG_ERR("could not find the shapes of chunk rows from %lld: %d", (long long)first_row, getLastError());
+        free_chunkmap(band);
+        return;
+    }
+    int64_t first_piece = stitching->piece_count;
+
+    for (int i = 0; i < band->shape_count; ++i)
+    {
+        chunkshape* shape = &band->shape_list[i];
+        pixel colour = shape->boundaries_length ? get_chunk_at_index(band, band->boundary_indices[shape->boundaries_offset])->average_colour : shape->colour;
+        stitching->pieces[first_piece + i] = (band_piece){ first_piece + i, 0, 0, NSVG_RGB(colour.r, colour.g, colour.b) };
+    }
+    stitching->piece_count += band->shape_count;
+
+    memset(stitching->band_above, 0, band->map_width);
+
+    if (first_row > 0)
+        join_band_pieces(stitching, band, first_piece);
+
+    spill_held_band(stitching);
+    int last_row = band->map_height - 1;
+
+    for (int x = 0; x < band->map_width; ++x)
+    {
+        pixelchunk* chunk = get_chunk(band, x, last_row);
+        stitching->seam_chunks[x + 1] = *chunk;
+        stitching->seam_pieces[x] = first_piece + chunk->shape_index;
+    }
+    byte* above = stitching->held_above;
+    stitching->held_above = stitching->band_above;
+    stitching->band_above = above;
+    memset(stitching->held_below, 0, band->map_width);
+    stitching->held = band;
+    stitching->held_first_piece = first_piece;
+    stitching->held_first_row = first_row;
+    LOG_INFO("band from chunk row %lld had %d shapes, %lld pieces so far", (long long)first_row, band->shape_count, (long long)stitching->piece_count);
+}
+
+// The spill file outgrows a long on windows long before it gets too big to write
+int seek_spill(FILE* spill, int64_t offset)
+{
+#ifdef _WIN32
+    return _fseeki64(spill, offset, SEEK_SET);
+#else
+    return fseeko(spill, (off_t)offset, SEEK_SET);
+#endif
+}
+
+// Copies the spilled outlines into the svg grouped by shape, with the shapes in the order they first appear.
+// That is the order one map draws them in, so a shape inside another still goes on top of it.
+bool write_spilled_shapes(band_stitching* stitching)
+{
+    band_piece* pieces = stitching->pieces;
+    int64_t count = stitching->piece_count;
+
+    // a parent always comes before its piece, so going forward every parent already is a root
+    for (int64_t i = 0; i < count; ++i)
+        pieces[i].parent = pieces[pieces[i].parent].parent;
+
+    // counting sort on the roots, which keeps the pieces of a shape in order
+    int64_t* starts = calloc((size_t)count + 1, sizeof(int64_t));
+    int64_t* order = calloc((size_t)count + 1, sizeof(int64_t));
+
+    if (!starts || !order)
+    {
+        LOG_ERR("could not allocate the drawing order of %lld pieces", (long long)count);
+        setError(ASSUMPTION_WRONG);
+        free(starts);
+        free(order);
+        return false;
+    }
+
+    for (int64_t i = 0; i < count; ++i)
+        ++starts[pieces[i].parent + 1];
+
+    for (int64_t i = 0; i < count; ++i)
+        starts[i + 1] += starts[i];
+
+    for (int64_t i = 0; i < count; ++i)
+        order[starts[pieces[i].parent]++] = i;
+
+    free(starts);
+    FILE* output = isBadError() ? NULL : start_svg_file(stitching->sink.map_width, stitching->sink.map_height);
+
+    if (!output)
+    {
+        free(order);
+        return false;
+    }
+    LOG_INFO("writing %lld shape pieces from %lld spilled bytes", (long long)count, (long long)stitching->spill_length);
+    char* polygon = NULL;
+    int64_t polygon_capacity = 0;
+
+    for (int64_t i = 0; i < count; ++i)
+    {
+        band_piece* piece = &pieces[order[i]];
+
+        if (!piece->length)
+            continue;
+
+        if (piece->length > polygon_capacity)
+        {
+            free(polygon);
+            polygon_capacity = piece->length;
+            polygon = malloc((size_t)polygon_capacity);
+        }
+
+        if (!polygon || seek_spill(stitching->spill, piece->offset) || fread(polygon, 1, (size_t)piece->length, stitching->spill) != (size_t)piece->length)
+        {
+            LOG_ERR("could not read back the %lld byte outline at %lld", (long long)piece->length, (long long)piece->offset);
+            setError(READ_FILE_ERROR);
+            break;
+        }
+        write_svg_path(output, pieces[piece->parent].colour, polygon, (size_t)piece->length);
+    }
+    finish_file(output);
+    free(polygon);
+    free(order);
+    return !isBadError();
+}
+
+void free_band_stitching(band_stitching* stitching)
+{
+    free(stitching->pieces);
+    free(stitching->seam_chunks);
+    free(stitching->seam_pieces);
+    free(stitching->seam_masks);
+    free(stitching->band_above);
+    free(stitching->held_above);
+    free(stitching->held_below);
+    free_chunkmap(stitching->held);
+    free(stitching->points);
+}
+
+bool vectorize_file_in_bands(vectorize_options options, shape_finder find_shapes, int64_t band_chunks)
+{
+    band_stitching stitching = { 0 };
+    stitching.sink = (chunk_band_sink){ band_chunks, 0, 0, stitch_band, &stitching };
+    options.band_sink = &stitching.sink;
+    options.decode_to_chunks = true;
+    options.quantize_chunks = true; //a band is all there is to quantize
+    stitching.options = options;
+    stitching.find_shapes = find_shapes;
+    stitching.kernels = get_pixel_kernels();
+    stitching.limit = similarity_limit(options.shape_colour_threshhold);
+    stitching.spill = tmpfile(); //gone once it is closed, whoever else vectorizes next to it
+
+    if (!stitching.spill)
+    {
+        LOG_ERR("could not open a temporary file to spill shapes into");
+        setError(ASSUMPTION_WRONG);
+        return false;
+    }
+    LOG_INFO("vectorizing '%s' in bands of at most %lld chunks", options.file_path, (long long)band_chunks);
+    free_chunkmap(load_image_file_to_chunkmap(options)); //every band went to stitch_band, nothing is left over
+
+    if (!isBadError())
+        spill_held_band(&stitching); //nothing comes after the last band
+
+    bool written = !isBadError() && write_spilled_shapes(&stitching);
+    fclose(stitching.spill);
+    free_band_stitching(&stitching);
+    return written;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../chunkmap.h"
+#include "usage.h"
+
+// Chunks held in one band when the caller has no budget of its own, a band of a few hundred megabytes at most
+extern const int64_t DEFAULT_BAND_CHUNKS;
+
+// Vectorizes options.file_path for images too big for one chunkmap, and writes the svg to OUTPUT_PATH.
+// The file is decoded a band of chunk rows at a time and find_shapes runs on every band on its own.
+// Shapes that carry on over a seam are joined up and drawn in the colour they would have had in one map.
+// Finished outlines are spilled to a temporary file, so only two bands and a few numbers per shape are held.
+bool vectorize_file_in_bands(vectorize_options options, shape_finder find_shapes, int64_t band_chunks);
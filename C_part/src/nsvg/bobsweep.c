@@ -7,10 +7,15 @@
 #include "mapparser.h"
 #include "../utility/error.h"
 #include "../sort.h"
+#include "../utility/workers.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
 typedef struct find_shapes_speed_stuff
 {
     int* shape_ints;
@@ -21,144 +26,262 @@ typedef struct find_shapes_speed_stuff
     int* border_counts;
     int* border_offsets;
     int* border_chunk_indices;
-    vector2* border_chunk_offsets;
+    chunkmap* map;
 } find_shapes_speed_stuff;
 
-void shape_initial_sweep(chunkmap* map, find_shapes_speed_stuff* stuff, float threshold)
+// The border walk tries neighbours column by column, which decides between equally good turns
+const int SWEEP_ORDER[NEIGHBOUR_COUNT] = { 0, 3, 5, 1, 6, 2, 4, 7 };
+
+// shape_ints and border_bits are laid out like the chunk grid, ghost ring included, so the same neighbour offsets work on all of them
+int grid_index(chunkmap* map, int chunk_index)
 {
-    stuff->shape_ints = calloc(map->map_width * map->map_height, sizeof(int));
-    int next_shape_int = 0;
-    LOG_INFO("Initial Shape Sweep");
+    return chunk_index % map->map_width + (chunk_index / map->map_width) * map->chunk_stride;
+}
 
-    for (int x = 0; x < map->map_width; ++x)
-    {
-        for (int y = 0; y < map->map_height; ++y)
-        {
-            int current = x + y * map->map_width;
-            int x_in_range = (x + 1 < map->map_width);
-            int y_in_range = (y + 1 < map->map_height);
-            int capped_x = (x_in_range * 2 + (!x_in_range) * 1);
-            int capped_y = (y_in_range * 2 + (!y_in_range) * 1);
-            
-            for (int adj_x = 0 - (x > 0) * 1; adj_x < capped_x; ++adj_x)
-            {
-                for (int adj_y = 0 - (y > 0) * 1; adj_y < capped_y; ++adj_y)
-                {
-                    int similarity = colours_are_similar(map->groups_array_2d[x][y].average_colour, map->groups_array_2d[x+adj_x][y+adj_y].average_colour, threshold);
-                    int val = (((adj_x != 0) | (adj_y != 0)) * similarity * stuff->shape_ints[current + adj_x + adj_y * map->map_width]);
-                    stuff->shape_ints[current] = (!val * stuff->shape_ints[current]) + val;
-                }
-            }
+void* create_shape_grid(chunkmap* map, size_t element_size)
+{
+    char* grid = calloc((size_t)map->chunk_stride * (map->map_height + 2), element_size);
+    return grid + (map->chunk_stride + 1) * element_size;
+}
 
-            next_shape_int += 1 * (!stuff->shape_ints[current]); // Goes up every time a chunk has no similar neighbours with chunks
-            int val = next_shape_int * (!stuff->shape_ints[current]);
-            stuff->shape_ints[current] = (!val * stuff->shape_ints[current]) + val; // Assigns the incremented next_shape_int to this pixelchunk if it had no similar neighbours
-        }
+void free_shape_grid(chunkmap* map, void* grid, size_t element_size)
+{
+    free((char*)grid - (map->chunk_stride + 1) * element_size);
+}
+
+// Gives the ghost ring a shape index no real chunk has
+void set_ghost_shape_ints(chunkmap* map, find_shapes_speed_stuff* stuff, int ghost_shape)
+{
+    for (int x = -1; x <= map->map_width; ++x)
+    {
+        stuff->shape_ints[x - map->chunk_stride] = ghost_shape;
+        stuff->shape_ints[x + map->map_height * map->chunk_stride] = ghost_shape;
     }
 
-    stuff->num_shapes = next_shape_int;
-    LOG_INFO("Num Shapes calculated to: %d", stuff->num_shapes);
-    LOG_INFO("Fixing Indices");
-    
     for (int y = 0; y < map->map_height; ++y)
     {
-        for (int x = 0; x < map->map_width; ++x)
-        {
-            int current = x + y * map->map_width;
-            --stuff->shape_ints[current];
-        }
+        stuff->shape_ints[y * map->chunk_stride - 1] = ghost_shape;
+        stuff->shape_ints[map->map_width + y * map->chunk_stride] = ghost_shape;
     }
 }
 
-void shape_aggregate_sweep(chunkmap* map, find_shapes_speed_stuff* stuff, float threshold)
+// Every chunk links to a chunk of its shape with a lower index, so the root of a shape is its first chunk in raster order.
+// Links only ever move towards lower indices, which lets the bands merge along their seams at the same time without locks.
+#ifdef _WIN32
+typedef volatile LONG label_link;
+
+int32_t load_link(label_link* link)
 {
-    LOG_INFO("Shape Aggregation Sweep");
-    int original_count = stuff->num_shapes;
-    int *de_duplicated_indices = calloc(stuff->num_shapes * 2, sizeof(int));
-    int *index_gaps = de_duplicated_indices + stuff->num_shapes;
+    return InterlockedCompareExchange(link, 0, 0);
+}
 
-    for (int i = 0; i < stuff->num_shapes; ++i)
-        de_duplicated_indices[i] = i;
-    
-    for (int x = 0; x < map->map_width; ++x)
+int swap_link(label_link* link, int32_t expected, int32_t desired)
+{
+    return InterlockedCompareExchange(link, desired, expected) == expected;
+}
+
+#else
+typedef volatile int32_t label_link;
+
+int32_t load_link(label_link* link)
+{
+    return __atomic_load_n(link, __ATOMIC_ACQUIRE);
+}
+
+int swap_link(label_link* link, int32_t expected, int32_t desired)
+{
+    return __atomic_compare_exchange_n(link, &expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+#endif
+
+int32_t find_label_root(label_link* links, int32_t index)
+{
+    while (1)
     {
-        for (int y = 0; y < map->map_height; ++y)
-        {
-            int current = x + y * map->map_width;
-            int x_in_range = (x + 1 < map->map_width);
-            int y_in_range = (y + 1 < map->map_height);
-            int capped_x = (x_in_range * 2 + (!x_in_range) * 1);
-            int capped_y = (y_in_range * 2 + (!y_in_range) * 1);
-            int skip_me = de_duplicated_indices[stuff->shape_ints[current]] == stuff->shape_ints[current];
-
-            for (int adj_x = 0 - (x > 0) * 1; adj_x < capped_x; ++adj_x)
-            {
-                for (int adj_y = 0 - (y > 0) * 1; adj_y < capped_y; ++adj_y)
-                {
-                    int adjacent = current + adj_x + adj_y * map->map_width;
-                    int similarity = colours_are_similar(map->groups_array_2d[x][y].average_colour, map->groups_array_2d[x + adj_x][y + adj_y].average_colour, threshold);
-                    int in_different_shapes = de_duplicated_indices[stuff->shape_ints[current]] != de_duplicated_indices[stuff->shape_ints[adjacent]];
-                    int val = similarity * in_different_shapes * skip_me;
-                    int already_changed = de_duplicated_indices[stuff->shape_ints[adjacent]] != stuff->shape_ints[adjacent];
-                    de_duplicated_indices[stuff->shape_ints[adjacent]] = (de_duplicated_indices[stuff->shape_ints[adjacent]] * !val) + (de_duplicated_indices[stuff->shape_ints[current]] * val);
-                    stuff->num_shapes += -1 * val * !already_changed;
-                }
-            }
-        }
+        int32_t parent = load_link(&links[index]);
+
+        if (parent == index)
+            return index;
+
+        int32_t grandparent = load_link(&links[parent]);
+
+        if (grandparent != parent)
+            swap_link(&links[index], parent, grandparent); //path halving, losing the race to another thread only costs a longer walk later
+
+        index = grandparent;
     }
-    int running_gaps = 0;
-    
-    for (int i = 0; i < original_count; ++i)
+}
+
+void join_labels(label_link* links, int32_t a, int32_t b)
+{
+    while (1)
     {
-        index_gaps[i] = running_gaps;
-        running_gaps += 1 * (de_duplicated_indices[i] != i);
+        a = find_label_root(links, a);
+        b = find_label_root(links, b);
+
+        if (a == b)
+            return;
+
+        int32_t high = a > b ? a : b;
+        int32_t low = a > b ? b : a;
+
+        if (swap_link(&links[high], high, low))
+            return;
     }
-    int lost_shapes = original_count - stuff->num_shapes;
-    
-    if (lost_shapes)
+}
+
+typedef struct
+{
+    chunkmap* map;
+    find_shapes_speed_stuff* stuff;
+    label_link* links;
+    int* row_labels; //how many shapes start on each row, then the label of the first one
+} labeling_stuff;
+
+// Joins a chunk to its similar neighbours among NW, N, NE and W, the ones that come before it in raster order
+void join_earlier_neighbours(labeling_stuff* stuff, int x, int y, int first_neighbour, int last_neighbour)
+{
+    chunkmap* map = stuff->map;
+    int32_t index = x + y * map->map_width;
+    byte similar_neighbours = map->similar_neighbours[x + y * map->chunk_stride];
+
+    for (int k = first_neighbour; k < last_neighbour; ++k)
+    {
+        if ((similar_neighbours >> k) & 1)
+            join_labels(stuff->links, index, index + NEIGHBOUR_X[k] + NEIGHBOUR_Y[k] * map->map_width);
+    }
+}
+
+// Labels a band on its own, the row above it belongs to another band and is joined in once every band is done
+void label_band(void* userdata, int band_start, int band_end)
+{
+    labeling_stuff* stuff = userdata;
+    chunkmap* map = stuff->map;
+
+    for (int y = band_start; y < band_end; ++y)
     {
-        LOG_INFO("Found %d duplicate shapes", lost_shapes);
-        LOG_INFO("Correcting Indices");
-        
         for (int x = 0; x < map->map_width; ++x)
         {
-            for (int y = 0; y < map->map_height; ++y)
-            {
-                int current = x + y * map->map_width;
-                int de_dup_shape_index = de_duplicated_indices[stuff->shape_ints[current]];
-                int val = de_dup_shape_index - index_gaps[de_dup_shape_index];
-                stuff->shape_ints[current] = val;
-            }
+            int32_t index = x + y * map->map_width;
+            stuff->links[index] = index;
+            join_earlier_neighbours(stuff, x, y, y == band_start ? 3 : 0, 4);
         }
     }
-    
-    else
+}
+
+// run_in_bands splits the rows the same way every time, so each band can stitch its first row onto the band above
+void join_band_seam(void* userdata, int band_start, int band_end)
+{
+    (void)band_end; //only the band's first row has a seam to join
+    labeling_stuff* stuff = userdata;
+
+    if (band_start == 0)
+        return;
+
+    for (int x = 0; x < stuff->map->map_width; ++x)
     {
-        LOG_INFO("No Shapes to De-Duplicate");
+        join_earlier_neighbours(stuff, x, band_start, 0, 3);
     }
-    free(de_duplicated_indices);
+}
 
+void count_row_roots(void* userdata, int band_start, int band_end)
+{
+    labeling_stuff* stuff = userdata;
+    int width = stuff->map->map_width;
+
+    for (int y = band_start; y < band_end; ++y)
     {
-        int bad_ness = 0;
-        
+        int roots = 0;
+
+        for (int32_t index = y * width; index < (y + 1) * width; ++index)
+        {
+            roots += stuff->links[index] == index;
+        }
+        stuff->row_labels[y] = roots;
+    }
+}
+
+void label_roots(void* userdata, int band_start, int band_end)
+{
+    labeling_stuff* stuff = userdata;
+    chunkmap* map = stuff->map;
+
+    for (int y = band_start; y < band_end; ++y)
+    {
+        int label = stuff->row_labels[y];
+
         for (int x = 0; x < map->map_width; ++x)
         {
-            for (int y = 0; y < map->map_height; ++y)
-            {
-                int current = x + y * map->map_width;
-                bad_ness = stuff->shape_ints[current] < 0 || stuff->shape_ints[current] >= stuff->num_shapes;
-            }
+            int32_t index = x + y * map->map_width;
+
+            if (stuff->links[index] == index)
+                stuff->stuff->shape_ints[x + y * map->chunk_stride] = label++;
         }
+    }
+}
 
-        if (bad_ness)
+void label_from_roots(void* userdata, int band_start, int band_end)
+{
+    labeling_stuff* stuff = userdata;
+    chunkmap* map = stuff->map;
+
+    for (int y = band_start; y < band_end; ++y)
+    {
+        for (int x = 0; x < map->map_width; ++x)
         {
-            LOG_ERR("Somehow De-Duplication failed to correct Shape Indices");
-            setError(ASSUMPTION_WRONG);
-            return;
+            int32_t index = x + y * map->map_width;
+            int32_t root = find_label_root(stuff->links, index);
+
+            if (root != index)
+                stuff->stuff->shape_ints[x + y * map->chunk_stride] = stuff->stuff->shape_ints[grid_index(map, root)];
         }
     }
 }
 
+// Connected component labeling over row bands: every band is labeled on its own thread,
+// the bands are then joined along their seams, and finally every chunk takes the label of its root.
+// Shapes are numbered by where they first appear in raster order.
+void label_shapes(chunkmap* map, find_shapes_speed_stuff* stuff, int thread_count)
+{
+    LOG_INFO("Labeling shapes with %d threads", thread_count);
+    stuff->shape_ints = create_shape_grid(map, sizeof(int));
+    labeling_stuff labeling = {
+        map, stuff,
+        calloc((size_t)map->map_width * map->map_height, sizeof(label_link)),
+        calloc(map->map_height, sizeof(int))
+    };
+
+    if (!labeling.links || !labeling.row_labels || !stuff->shape_ints)
+    {
+        LOG_ERR("Could not allocate shape labels");
+        setError(ASSUMPTION_WRONG);
+        free((void*)labeling.links);
+        free(labeling.row_labels);
+        return;
+    }
+
+    run_in_bands(thread_count, map->map_height, label_band, &labeling);
+    run_in_bands(thread_count, map->map_height, join_band_seam, &labeling);
+    run_in_bands(thread_count, map->map_height, count_row_roots, &labeling);
+
+    stuff->num_shapes = 0;
+
+    for (int y = 0; y < map->map_height; ++y)
+    {
+        int roots = labeling.row_labels[y];
+        labeling.row_labels[y] = stuff->num_shapes;
+        stuff->num_shapes += roots;
+    }
+    LOG_INFO("Num Shapes calculated to: %d", stuff->num_shapes);
+
+    run_in_bands(thread_count, map->map_height, label_roots, &labeling);
+    run_in_bands(thread_count, map->map_height, label_from_roots, &labeling);
+    set_ghost_shape_ints(map, stuff, stuff->num_shapes);
+
+    free((void*)labeling.links);
+    free(labeling.row_labels);
+}
+
 void move_shape_indices(chunkmap* map, find_shapes_speed_stuff* stuff)
 {
     LOG_INFO("Counting up Shape numbers");
@@ -171,8 +294,7 @@ void move_shape_indices(chunkmap* map, find_shapes_speed_stuff* stuff)
     {
         for (int x = 0; x < map->map_width; ++x)
         {
-            int current = x + y * map->map_width;
-            int index = stuff->shape_ints[current];
+            int index = stuff->shape_ints[x + y * map->chunk_stride];
 
             if (index >= stuff->num_shapes || index < 0)
             {
@@ -217,7 +339,7 @@ void move_shape_indices(chunkmap* map, find_shapes_speed_stuff* stuff)
         for (int x = 0; x < map->map_width; ++x)
         {
             int current_chunk = x + y * map->map_width;
-            int *p = &increasing_shape_indices[stuff->shape_ints[current_chunk]];
+            int *p = &increasing_shape_indices[stuff->shape_ints[x + y * map->chunk_stride]];
             stuff->chunk_index_of[*p] = current_chunk;
             *p += 1;
         }
@@ -230,7 +352,7 @@ void free_shape_stuff(find_shapes_speed_stuff* stuff)
         return;
 
     if (stuff->shape_ints)
-        free(stuff->shape_ints);
+        free_shape_grid(stuff->map, stuff->shape_ints, sizeof(int));
 
     stuff->shape_ints = 0;
 
@@ -245,17 +367,36 @@ void free_shape_stuff(find_shapes_speed_stuff* stuff)
 
     stuff->border_counts = 0;
 
-    if (stuff->border_chunk_offsets)
-        free(stuff->border_chunk_offsets);
+    if (stuff->border_chunk_indices)
+        free(stuff->border_chunk_indices);
 
-    stuff->border_chunk_offsets = 0;
+    stuff->border_chunk_indices = 0;
 
     if (stuff)
         free(stuff);
 }
 
+// Bit k is set when neighbour k is in another shape or off the image, cell is a grid index.
+// Similar neighbours always share the shape, so only the others need their shapes compared.
+// Similarity isn't transitive though, a neighbour that isn't similar can still be in the same shape.
+byte other_shape_neighbours(chunkmap* map, find_shapes_speed_stuff* stuff, int cell)
+{
+    byte similar_neighbours = map->similar_neighbours[cell];
+    byte other_shapes = 0;
+
+    if (similar_neighbours == ALL_NEIGHBOURS)
+        return 0;
+
+    for (int k = 0; k < NEIGHBOUR_COUNT; ++k)
+    {
+        int other = !((similar_neighbours >> k) & 1) && stuff->shape_ints[cell + map->neighbour_offsets[k]] != stuff->shape_ints[cell];
+        other_shapes |= (byte)(other << k);
+    }
+    return other_shapes;
+}
+
 
-find_shapes_speed_stuff* produce_shape_stuff(chunkmap* map, float threshold)
+find_shapes_speed_stuff* produce_shape_stuff(chunkmap* map, float threshold, int thread_count)
 {
     if (isBadError())
     {
@@ -271,19 +412,24 @@ find_shapes_speed_stuff* produce_shape_stuff(chunkmap* map, float threshold)
     }
 
     find_shapes_speed_stuff* output = calloc(1, sizeof(find_shapes_speed_stuff));
+    output->map = map;
 
     LOG_INFO("Find Shapes Speedy with threshold: %.1f", threshold);
-    shape_initial_sweep(map, output, threshold);
+    find_similar_neighbours(map, threshold, thread_count);
 
-    shape_aggregate_sweep(map, output, threshold);
+    if (isBadError())
+    {
+        free_shape_stuff(output);
+        return NULL;
+    }
+    label_shapes(map, output, thread_count);
 
     if (isBadError())
     {
-        LOG_ERR("Shape Aggregate Sweep failed with: %d", getLastError());
+        LOG_ERR("Shape Labeling failed with: %d", getLastError());
+        free_shape_stuff(output);
         return NULL;
     }
-    
-    LOG_INFO("Num Shapes Now calculated to: %d", output->num_shapes);
 
     move_shape_indices(map, output);
     if (isBadError())
@@ -331,7 +477,7 @@ find_shapes_speed_stuff* produce_shape_stuff(chunkmap* map, float threshold)
     output->border_counts = calloc(output->num_shapes * 3, sizeof(int));
     output->border_offsets = output->border_counts + output->num_shapes;
     int *border_running_indices = output->border_offsets + output->num_shapes;
-    char *border_bits = calloc(map->map_width * map->map_height, sizeof(char));
+    char *border_bits = create_shape_grid(map, sizeof(char));
     int border_total = 0;
 
     for (int i = 0; i < output->num_shapes; ++i)
@@ -339,20 +485,10 @@ find_shapes_speed_stuff* produce_shape_stuff(chunkmap* map, float threshold)
         for (int j = 0; j < output->shape_counts[i]; ++j)
         {
             // Look through all coordinates
-            // See if any adjacents either: don't exist (edge of the image) or are a different colour
-            int current = output->chunk_index_of[j + output->shape_offsets[i]];
-            int x = current % map->map_width;
-            int y = current / map->map_width;
-            int edge = (x < 1) | (y < 1) | (x + 1 >= map->map_width) | (y + 1 >= map->map_height);
-            int border = edge;
-
-            for (int adj_x = (2 * edge) + (-1 * !edge); adj_x < 2; ++adj_x)
-            {
-                for (int adj_y = (2 * edge) + (-1 * !edge); adj_y < 2; ++adj_y)
-                {
-                    border |= output->shape_ints[current] != output->shape_ints[x + adj_x + (y + adj_y) * map->map_width];
-                }
-            }
+            // See if any adjacents either: don't exist (edge of the image) or are a different shape
+            // the ghost ring has a shape of its own, so chunks on the edge of the image always count
+            int current = grid_index(map, output->chunk_index_of[j + output->shape_offsets[i]]);
+            int border = other_shape_neighbours(map, output, current) != 0;
 
             border_total += 1 * border;
             output->border_counts[i] += 1 * border;
@@ -377,7 +513,6 @@ find_shapes_speed_stuff* produce_shape_stuff(chunkmap* map, float threshold)
 
     LOG_INFO("Adding unsorted boundary indices");
     output->border_chunk_indices = calloc(border_total, sizeof(int));
-    output->border_chunk_offsets = calloc(border_total, sizeof(vector2));
 
     int iterations = 0;
     for (int i = 0; i < output->num_shapes; ++i)
@@ -397,17 +532,15 @@ find_shapes_speed_stuff* produce_shape_stuff(chunkmap* map, float threshold)
             current_vec.y = y;
             vector2 towards_boundary = { 0 };
             int num_boundaries = 0;
-            for (int adj_x = -1; adj_x < 2; ++adj_x)
+            int current_cell = x + y * map->chunk_stride;
+            byte other_shapes = other_shape_neighbours(map, output, current_cell);
+
+            for (int k = 0; k < NEIGHBOUR_COUNT; ++k)
             {
-                for (int adj_y = -1; adj_y < 2; ++adj_y)
-                {
-                    int is_boundary = (x + adj_x < 0) | (x + adj_x >= map->map_width) | (y + adj_y < 0) | (y + adj_y >= map->map_height);     
-                    int corrected_index = current_chunk + adj_x * !is_boundary + (adj_y * !is_boundary) * map->map_width;
-                    is_boundary |= output->shape_ints[corrected_index] != output->shape_ints[current_chunk]; // Different shape borders
-                    num_boundaries += is_boundary;
-                    towards_boundary.x += adj_x * is_boundary;
-                    towards_boundary.y += adj_y * is_boundary;
-                }
+                int is_boundary = (other_shapes >> k) & 1; // Different shape or off the image
+                num_boundaries += is_boundary;
+                towards_boundary.x += NEIGHBOUR_X[k] * is_boundary;
+                towards_boundary.y += NEIGHBOUR_Y[k] * is_boundary;
             }
             towards_boundary.x /= (float)(num_boundaries + 1 * !num_boundaries);
             towards_boundary.y /= (float)(num_boundaries + 1 * !num_boundaries);
@@ -417,29 +550,22 @@ find_shapes_speed_stuff* produce_shape_stuff(chunkmap* map, float threshold)
             int next_boundary_index = 0;
 
             
-            int x_in_range = (x + 1 < map->map_width);
-            int y_in_range = (y + 1 < map->map_height);
-            int capped_x = (x_in_range * 2 + (!x_in_range) * 1);
-            int capped_y = (y_in_range * 2 + (!y_in_range) * 1);
-            for (int adj_x = -1 * (x > 0); adj_x < capped_x; ++adj_x)
+            for (int k = 0; k < NEIGHBOUR_COUNT; ++k)
             {
-                for (int adj_y = -1 * (y > 0); adj_y < capped_y; ++adj_y)
-                {
-                    int adjacent = x + adj_x + (y + adj_y) * map->map_width;
-                    //if (adjacent < 0 || adjacent >= total_found)
-                        //LOG_ERR("Border detection Out-Of-Bounds error in adjacent block");//DEBUG
-                    vector2 my_vec = vec_normalize((vector2){adj_x, adj_y});
-                    float angle = vec_angle_between(sum, my_vec);
-                    int angle_is_better = (angle < last_angle);
-                    int adjacent_in_same_shape = (output->shape_ints[adjacent] == output->shape_ints[current_chunk]);
-                    int is_border = border_bits[adjacent];
-                    int not_center = (adj_x || adj_y);
-
-                    int suitable_adjacent = angle_is_better * adjacent_in_same_shape * not_center * is_border;
-                    
-                    next_boundary_index = (adjacent) * suitable_adjacent + next_boundary_index * (!suitable_adjacent);
-                    last_angle = (suitable_adjacent * angle) + last_angle * (!suitable_adjacent);
-                }
+                int adj_x = NEIGHBOUR_X[SWEEP_ORDER[k]];
+                int adj_y = NEIGHBOUR_Y[SWEEP_ORDER[k]];
+                int adjacent_cell = current_cell + map->neighbour_offsets[SWEEP_ORDER[k]];
+                int adjacent = current_chunk + adj_x + adj_y * map->map_width; //only used once it is known to be on the image
+                vector2 my_vec = vec_normalize((vector2){adj_x, adj_y});
+                float angle = vec_angle_between(sum, my_vec);
+                int angle_is_better = (angle < last_angle);
+                int adjacent_in_same_shape = (output->shape_ints[adjacent_cell] == output->shape_ints[current_cell]);
+                int is_border = border_bits[adjacent_cell];
+
+                int suitable_adjacent = angle_is_better * adjacent_in_same_shape * is_border;
+                
+                next_boundary_index = (adjacent) * suitable_adjacent + next_boundary_index * (!suitable_adjacent);
+                last_angle = (suitable_adjacent * angle) + last_angle * (!suitable_adjacent);
             }
 
             // Assign next x, y, current_chunk
@@ -457,79 +583,60 @@ find_shapes_speed_stuff* produce_shape_stuff(chunkmap* map, float threshold)
             ++iterations;
         }
     }
-
-
+    free_shape_grid(map, border_bits, sizeof(char));
 
     return output;
 }
 
-void sweepfill_chunkmap(chunkmap* map, float threshold)
+void sweepfill_chunkmap(chunkmap* map, float threshold, int thread_count)
 {
-    find_shapes_speed_stuff* stuff = produce_shape_stuff(map, threshold);
+    find_shapes_speed_stuff* stuff = produce_shape_stuff(map, threshold, thread_count);
+
+    if (!stuff)
+        return;
+
     map->shape_count = stuff->num_shapes;
     // START CONVERT TO ACTUAL SHAPES
-    chunkshape* actual_shapes = calloc(1, sizeof(chunkshape));
-    chunkshape* current = actual_shapes;
-    chunkshape* previous = NULL;
+    //the shapes keep the same layout as the sweep, just packed into the map's index arrays
+    chunkshape* actual_shapes = arena_alloc(map->allocator, sizeof(chunkshape) * (stuff->num_shapes ? stuff->num_shapes : 1));
+    int chunk_total = 0;
+    int border_total = 0;
 
     for (int i = 0; i < stuff->num_shapes; ++i)
     {
-        current->previous = previous;
-        current->next = (i + 1 < stuff->num_shapes ? calloc(1, sizeof(chunkshape)) : NULL);
+        chunk_total += stuff->shape_counts[i];
+        border_total += stuff->border_counts[i];
+    }
+    map->chunk_indices = arena_alloc(map->allocator, sizeof(int32_t) * (chunk_total ? chunk_total : 1));
+    map->boundary_indices = arena_alloc(map->allocator, sizeof(int32_t) * (border_total ? border_total : 1));
+    int chunks_offset = 0;
+    int boundaries_offset = 0;
+
+    for (int i = 0; i < stuff->num_shapes; ++i)
+    {
+        chunkshape* current = &actual_shapes[i];
         current->boundaries_length = stuff->border_counts[i];
-        current->boundaries = calloc(1, sizeof(pixelchunk_list));
+        current->boundaries_offset = boundaries_offset;
         current->chunks_amount = stuff->shape_counts[i];
-        current->chunks = calloc(1, sizeof(pixelchunk_list));
-        int first_chunk = stuff->chunk_index_of[stuff->shape_offsets[i]];
-        int first_chunk_x = first_chunk % map->map_width;
-        int first_chunk_y = first_chunk / map->map_width;
-        current->colour = map->groups_array_2d[first_chunk_x][first_chunk_y].average_colour;
+        current->chunks_offset = chunks_offset;
+        current->colour = get_chunk_at_index(map, stuff->chunk_index_of[stuff->shape_offsets[i]])->average_colour;
 
-        pixelchunk_list *current_border = current->boundaries;
         for (int j = 0; j < current->boundaries_length; ++j)
         {
-            int chunk_index = stuff->border_chunk_indices[j + stuff->border_offsets[i]];
-            int chunk_x = chunk_index % map->map_width;
-            int chunk_y = chunk_index / map->map_width;
-            current_border->chunk_p = &map->groups_array_2d[chunk_x][chunk_y];
-            vector2 offset = stuff->border_chunk_offsets[j + stuff->border_offsets[i]];
-            current_border->chunk_p->border_location = (vector2){ (float)chunk_x + offset.x, (float)chunk_y + offset.y };
-            current_border->next = (j + 1 < current->boundaries_length ? calloc(1, sizeof(pixelchunk_list)) : NULL);
-            current_border->firstitem = current->boundaries;
-
-            current_border = current_border->next;
+            map->boundary_indices[boundaries_offset++] = stuff->border_chunk_indices[j + stuff->border_offsets[i]];
         }
 
-        pixelchunk_list *current_chunk = current->chunks;
         for (int j = 0; j < current->chunks_amount; ++j)
         {
             int chunk_index = stuff->chunk_index_of[j + stuff->shape_offsets[i]];
-            int chunk_x = chunk_index % map->map_width;
-            int chunk_y = chunk_index / map->map_width;
-            current_chunk->chunk_p = &map->groups_array_2d[chunk_x][chunk_y];
-            current_chunk->next = (j + 1 < current->chunks_amount ? calloc(1, sizeof(pixelchunk_list)) : NULL);
-            current_chunk->firstitem = current->chunks;
-
-            current_chunk = current_chunk->next;
+            get_chunk_at_index(map, chunk_index)->shape_index = i;
+            map->chunk_indices[chunks_offset++] = chunk_index;
         }
-
-        previous = current;
-        current = current->next;
     }
 
     // END CONVERT TO ACTUAL SHAPES
 
-    free(map->shape_list);
-    map->shape_list = actual_shapes;
-
-    write_chunkmap_to_png(map, "chunkmap.png");
-
-    if(isBadError()) {
-        LOG_ERR("write_chunkmap_to_png failed with code: %d\n", getLastError());
-        free_chunkmap(map);
-        free_shape_stuff(stuff);
-        return NULL;
-    }
+    map->shape_list = actual_shapes; //bobsweep_chunkmap_for_nsvg prints the chunkmap, a band of a bigger image never is
     free_shape_stuff(stuff);
     return;
 }
@@ -2,6 +2,7 @@
 #include <nanosvg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 //#include <unistd.h> //linux only
 #include <string.h>
 
@@ -19,17 +20,25 @@ void free_template(char* data) {
 	free(data);
 }
 
-char* format_template(char* template, int width, int height) {
-	int extra_len = strlen(template) + 40;
+char* format_template(char* template, int64_t width, int64_t height) {
+	double w = (double)width, h = (double)height; //a float would round widths past 2^24
+	int extra_len = snprintf(NULL, 0, template, w, h, w, h) + 1;
 	char *modified_template = calloc(extra_len, sizeof(char));
-	snprintf(modified_template, extra_len, template, (float)width, (float)height, (float)width, (float)height);
+
+	if (modified_template == NULL) {
+		LOG_ERR("something went wrong allocating svg space.");
+		setError(SVG_SPACE_ERROR);
+		free_template(template);
+		return NULL;
+	}
+	snprintf(modified_template, extra_len, template, w, h, w, h);
 
 	free_template(template);
 	return modified_template;
 }
 
 ///nanosvg copypaste
-char* gettemplate(int width, int height) {
+char* gettemplate(int64_t width, int64_t height) {
     FILE* fp = NULL;
 	size_t size;
 	char* data = NULL;
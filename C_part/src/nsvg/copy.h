@@ -1,9 +1,10 @@
 #pragma once
 
+#include <stdint.h>
 #include <nanosvg.h>
 
 int NSVG_RGB(int r, int g, int b);
 
-char* gettemplate(int width, int height);
+char* gettemplate(int64_t width, int64_t height);
 
 void free_template(char* data);
@@ -13,30 +13,33 @@
 #include "copy.h"
 #include "mapping.h"
 #include "../sort.h"
+#include "../utility/workers.h"
 
 const int NONE_FILLED = -1;
 
 typedef struct
 {
     chunkmap* map;
-    NSVGimage* output;
+    arena* allocator;
+    NSVGshape* shape;
     NSVGpath* first_path;
-    NSVGpaint* shapescolour;
+    NSVGpaint shapescolour;
 } svg_hashies_iter;
 
 //assumes first path and first shape are given
-bool iterate_new_path(pixelchunk* chunk, svg_hashies_iter* udata) {
-    NSVGshape* current = udata->output->shapes;
+bool iterate_new_path(int32_t chunk_index, svg_hashies_iter* udata) {
+    pixelchunk* chunk = get_chunk_at_index(udata->map, chunk_index);
+    vector2 border_location = get_border_location(udata->map, chunk_index);
+    NSVGshape* current = udata->shape;
     NSVGpath* currentpath = current->paths;
     NSVGpath* nextsegment;
 
     //add chunk to path if its a boundary
     if(currentpath->pts[0] == NONE_FILLED) { //first point not supplied
-        currentpath->pts[0] = chunk->border_location.x; //x1
-        currentpath->pts[1] = chunk->border_location.y; //y1
+        currentpath->pts[0] = border_location.x; //x1
+        currentpath->pts[1] = border_location.y; //y1
 
-        udata->shapescolour = calloc(1, sizeof(NSVGpaint));
-        NSVGpaint* fill = udata->shapescolour;
+        NSVGpaint* fill = &udata->shapescolour;
         fill->type = NSVG_PAINT_COLOR;
 
         fill->color = NSVG_RGB(
@@ -48,8 +51,8 @@ bool iterate_new_path(pixelchunk* chunk, svg_hashies_iter* udata) {
     }
 
     else if(currentpath->pts[2] == NONE_FILLED) { //first point supplied but not first path
-        currentpath->pts[2] = chunk->border_location.x; //x2
-        currentpath->pts[3] = chunk->border_location.y; //y2
+        currentpath->pts[2] = border_location.x; //x2
+        currentpath->pts[3] = border_location.y; //y2
 
         vector2 previous_coord = {
             currentpath->pts[0],
@@ -57,25 +60,24 @@ bool iterate_new_path(pixelchunk* chunk, svg_hashies_iter* udata) {
         };
 
         nextsegment = create_path(
+            udata->allocator,
             udata->map->input, 
             previous_coord,
-            chunk->border_location
+            border_location
         );
     }
 
     else { //first path supplied
-        int x = chunk->location.x;
-        int y = chunk->location.y;
-        
         vector2 previous_coord = {
             currentpath->pts[2],
             currentpath->pts[3],
         };
 
         nextsegment = create_path(
+            udata->allocator,
             udata->map->input, 
             previous_coord,
-            chunk->border_location
+            border_location
         );
     }
     int code = getLastError();
@@ -88,34 +90,118 @@ bool iterate_new_path(pixelchunk* chunk, svg_hashies_iter* udata) {
     return true;
 }
 
-void close_path(chunkmap* map, NSVGimage* output, NSVGpath* firstpath) {
+void close_path(arena* allocator, chunkmap* map, NSVGshape* shape, NSVGpath* firstpath) {
     vector2 realstart = {
-        output->shapes->paths->pts[2],
-        output->shapes->paths->pts[3],
+        shape->paths->pts[2],
+        shape->paths->pts[3],
     };
 
     vector2 realend = {
         firstpath->pts[0],
         firstpath->pts[1],
     };
-    NSVGpath* path = create_path(map->input, realstart, realend);
+    NSVGpath* path = create_path(allocator, map->input, realstart, realend);
     int code = getLastError();
     
     if(isBadError()) {
         LOG_ERR("create_path failed with code: %d", code);
         return;
     }
-    output->shapes->paths->next = path;
+    shape->paths->next = path;
 }
 
-void throw_on_max(unsigned long* subject) {
-    if(subject == (unsigned long*)0xffffffff) {
-        LOG_INFO("long is way too big!");
-        setError(OVERFLOW_ERROR);
+typedef struct
+{
+    chunkmap* map;
+    arena** worker_arenas; //handed over to the image once every shape is parsed
+    NSVGshape** shapes; //one slot per chunkshape so the shapes can be linked up in order afterwards
+    int first_drawn;
+} shape_parsing_stuff;
+
+bool too_small_to_draw(chunkshape* shape) {
+    return shape->boundaries_length < 2;
+}
+
+NSVGshape* parse_chunkshape(arena* allocator, chunkmap* map, chunkshape* chunkshape_p, int index, bool first) {
+    if(map->boundary_indices == NULL) {
+        LOG_ERR("boundary creation broken!");
+        setError(LOW_BOUNDARIES_CREATED);
+        return NULL;
+    }
+    char id[ID_LENGTH] = { 0 };
+
+    // runs on the pool workers, so no logging per shape here, every log line takes the logger's lock
+    if(first) {
+        strncpy(id, "firstshape", ID_LENGTH);
     }
+
+    else {
+        id[0] = (char)index;
+    }
+    NSVGshape* shape = create_shape(allocator, map, id, ID_LENGTH);
+
+    if(isBadError()) {
+        LOG_ERR("create_shape failed with code: %d", getLastError());
+        return NULL;
+    }
+    vector2 empty = {NONE_FILLED, NONE_FILLED};
+    NSVGpath* firstpath = create_path(allocator, map->input, empty, empty); //lets us wind back the path list
+    int code = getLastError();
+
+    if(isBadError()) {
+        LOG_ERR("create_path failed with code: %d", code);
+        return shape;
+    }
+    shape->paths = firstpath; //first shapes path
+
+    svg_hashies_iter shape_data = {
+        map, allocator, shape, firstpath, { 0 }
+    };
+
+    int32_t* boundary = map->boundary_indices + chunkshape_p->boundaries_offset;
+
+    for (int i = 0; i < chunkshape_p->boundaries_length; ++i)
+    {
+        iterate_new_path(boundary[i], &shape_data);
+    }
+    code = getLastError();
+
+    if(isBadError()) {
+        LOG_ERR("iterate_new_path failed with code: %d", code);
+        shape->paths = firstpath;
+        return shape;
+    }
+
+    else if(firstpath->pts[2] == NONE_FILLED) { //didnt form at least one path between two coordinates
+        LOG_ERR("NO PATHS FOUND");
+        setError(ASSUMPTION_WRONG);
+        return shape;
+    }
+    close_path(allocator, map, shape, firstpath);
+    shape->paths = firstpath; //wind back the paths
+
+    shape->fill = shape_data.shapescolour;
+
+    NSVGpaint stroke = {
+        NSVG_PAINT_NONE,
+        NSVG_RGB(0, 0, 0)
+    };
+    shape->stroke = stroke;
+    return shape;
 }
 
-void parse_map_into_nsvgimage(chunkmap* map, NSVGimage* output)
+// One shape per task, each one only builds its own paths
+void parse_shape_task(void* userdata, int task, int worker) {
+    shape_parsing_stuff* stuff = userdata;
+    chunkshape* chunkshape_p = &stuff->map->shape_list[task];
+
+    if(too_small_to_draw(chunkshape_p) || isBadError())
+        return;
+
+    stuff->shapes[task] = parse_chunkshape(stuff->worker_arenas[worker], stuff->map, chunkshape_p, task, task == stuff->first_drawn);
+}
+
+void parse_map_into_nsvgimage(chunkmap* map, NSVGimage* output, int thread_count)
 {
     LOG_INFO("checking if shapelist is null");
     //create the svg
@@ -124,119 +210,69 @@ void parse_map_into_nsvgimage(chunkmap* map, NSVGimage* output)
         setError(ASSUMPTION_WRONG);
         return;
     }
-    int low_boundary_shapes = 0;
-    LOG_INFO("creating first shape");
-    char* firstid = "firstshape";
-    long firstidlength = 10;
-    chunkshape* firstchunkshape = map->shape_list;
-    NSVGshape* firstshape = create_shape(map, firstid, firstidlength);
-    unsigned long i = 0;
-    LOG_INFO("iterating shapes list");
-
-    //iterate shapes
-    while(map->shape_list != NULL) {        
-        int chunkcount = map->shape_list->chunks_amount;
-
-        if(low_boundary_shapes >= map->shape_count) {
-            LOG_ERR("MOST BOUNDARIES NOT BIG ENOUGH");
-            setError(LOW_BOUNDARIES_CREATED);
-            return;
-        }
-
-        else if(map->shape_list->boundaries_length < 2) {
-            LOG_INFO("skipping shape with too small boundary");
-            ++i;
-            ++low_boundary_shapes;
-            map->shape_list = map->shape_list->next;
-            continue;
-        }
-
-        else if(map->shape_list->boundaries->chunk_p == NULL) {
-            LOG_ERR("boundary creation broken!");
-            setError(LOW_BOUNDARIES_CREATED);
-            return;
-        }
+    int shape_count = map->shape_count;
+    int* sizes = calloc(shape_count, sizeof(int));
+    int worker_count = thread_count > 1 ? thread_count : 1;
+    shape_parsing_stuff stuff = {
+        map, calloc(worker_count, sizeof(arena*)), calloc(shape_count, sizeof(NSVGshape*)), -1
+    };
+    int i = 0;
 
-        if(output->shapes == NULL) {
-            LOG_INFO("using first shape");
-            output->shapes = firstshape;
-        }
+    for (i = 0; i < shape_count; ++i) {
+        sizes[i] = map->shape_list[i].boundaries_length;
 
-        else {
-            LOG_INFO("creating new shape");
-            char longaschar = i;
-            NSVGshape* newshape = create_shape(map, &longaschar, 1);
-            output->shapes->next = newshape;
-            output->shapes = newshape;
-        }
-        vector2 empty = {NONE_FILLED, NONE_FILLED};
-        NSVGpath* firstpath = create_path(map->input, empty, empty); //lets us wind back the path list
-        int code = getLastError();
+        if(stuff.first_drawn < 0 && !too_small_to_draw(&map->shape_list[i]))
+            stuff.first_drawn = i;
+    }
 
-        if(isBadError()) {
-            LOG_ERR("create_path failed with code: %d", code);
-            return;
-        }
-        output->shapes->paths = firstpath; //first shapes path
+    for (i = 0; i < worker_count; ++i)
+        stuff.worker_arenas[i] = create_arena();
 
-        svg_hashies_iter shape_data = {
-            map, output, firstpath, NULL
-        };        
+    LOG_INFO("parsing %d shapes with %d threads", shape_count, thread_count);
+    run_tasks(thread_count, shape_count, sizes, parse_shape_task, &stuff);
 
-        LOG_INFO("iterating boundaries, count: %d ", map->shape_list->boundaries_length);
+    for (i = 0; i < worker_count; ++i) {
+        merge_arenas(nsvg_arena(output), stuff.worker_arenas[i]);
+        free_arena(stuff.worker_arenas[i]);
+    }
+    free(stuff.worker_arenas);
 
-        for (pixelchunk_list* iter = map->shape_list->boundaries; iter; iter = iter->next)
-        {
-            iterate_new_path(iter->chunk_p, &shape_data);
-        }
-        code = getLastError();
+    //link the shapes up in the order of the shape list so the output doesnt depend on which worker finished first
+    NSVGshape* last = NULL;
+    int low_boundary_shapes = 0;
 
-        if(isBadError()) {
-            LOG_ERR("iterate_new_path failed with code: %d", code);
-            return;
+    for (i = 0; i < shape_count; ++i) {
+        if(low_boundary_shapes >= map->shape_count && !isBadError()) {
+            LOG_ERR("MOST BOUNDARIES NOT BIG ENOUGH");
+            setError(LOW_BOUNDARIES_CREATED);
         }
 
-        else if(firstpath->pts[2] == NONE_FILLED) { //didnt form at least one path between two coordinates
-            LOG_ERR("NO PATHS FOUND");
-            setError(ASSUMPTION_WRONG);
-            return;
+        if(!stuff.shapes[i]) {
+            if(too_small_to_draw(&map->shape_list[i])) {
+                LOG_INFO("skipping shape with too small boundary");
+                ++low_boundary_shapes;
+            }
+            continue;
         }
-        LOG_INFO("closing path");
-        close_path(map, output, firstpath);
-        output->shapes->paths = firstpath; //wind back the paths
-        
-        //set the colour of the shape while prevent undefined behaviour
-        NSVGpaint fillcopy = {
-            shape_data.shapescolour->type,
-            shape_data.shapescolour->color
-        };
-        output->shapes->fill = fillcopy;
-        free(shape_data.shapescolour); //we held on to the dynamically allocated paint now we free it
 
-        NSVGpaint stroke = {
-            NSVG_PAINT_NONE,
-            NSVG_RGB(0, 0, 0)
-        };
-        output->shapes->stroke = stroke;        
+        if(last)
+            last->next = stuff.shapes[i];
 
-        throw_on_max(&i);
-        code = getLastError();
+        else
+            output->shapes = stuff.shapes[i];
 
-        if(isBadError()) {
-            LOG_ERR("throw_on_max failed with code: %d", code);
-            return;
-        }
-        ++i;
-        map->shape_list = map->shape_list->next; //go to next shape
+        last = stuff.shapes[i];
     }
-    map->shape_list = firstchunkshape;
-    LOG_INFO("Iterated %d shapes", count_shapes(map->shape_list));
+    free(stuff.shapes);
+    free(sizes);
 
-    if(firstshape->paths != NULL) {
-        output->shapes = firstshape;
+    if(isBadError()) {
+        LOG_ERR("parsing shapes failed with code: %d", getLastError());
+        return;
     }
+    LOG_INFO("Iterated %d shapes", shape_count);
 
-    else {
+    if(output->shapes == NULL) {
         LOG_INFO("not giving any paths to nsvgimage since no paths found");
-    }    
+    }
 }
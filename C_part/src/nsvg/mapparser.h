@@ -2,4 +2,4 @@
 #include <nanosvg.h>
 #include "../chunkmap.h"
 
-void parse_map_into_nsvgimage(chunkmap* map, NSVGimage* output);
+void parse_map_into_nsvgimage(chunkmap* map, NSVGimage* output, int thread_count);
@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <stddef.h>
 #include <nanosvg.h>
 
 #include "mapping.h"
@@ -81,10 +82,10 @@ void fill_beziercurve(float* beziercurve,
     beziercurve[7] = control_y2;
 }
 
-NSVGpath* create_path(image input, vector2 start, vector2 end) {
-    NSVGpath* output = calloc(1, sizeof(NSVGpath));
-    float* points = calloc(1, sizeof(float) * BEZIERCURVE_LENGTH);
-    output->pts = points;
+NSVGpath* create_path(arena* allocator, image input, vector2 start, vector2 end) {
+    //the points go right behind the path in the same allocation
+    NSVGpath* output = arena_alloc(allocator, sizeof(NSVGpath) + sizeof(float) * BEZIERCURVE_LENGTH);
+    output->pts = (float*)(output + 1);
     float boundingbox[4] = { 0, 0, input.width, input.height };
 
     fill_beziercurve(output->pts, BEZIERCURVE_LENGTH, start.x, start.y, end.x, end.y, 0, 0, 1, 1); //draw the top side of a box
@@ -93,8 +94,6 @@ NSVGpath* create_path(image input, vector2 start, vector2 end) {
 
     if(isBadError()) {
         LOG_ERR("fill_bounds failed with code: %d", code);
-        free(output);
-        free(points);        
         return NULL;
     }    
     
@@ -104,13 +103,12 @@ NSVGpath* create_path(image input, vector2 start, vector2 end) {
     return output;
 }
 
-NSVGshape* create_shape(chunkmap* map, char* id, long id_length) {    
-    NSVGshape* output = calloc(1, sizeof(NSVGshape));
+NSVGshape* create_shape(arena* allocator, chunkmap* map, char* id, long id_length) {    
+    NSVGshape* output = arena_alloc(allocator, sizeof(NSVGshape));
     fill_id(output->id, id, ID_LENGTH);
 
     if (isBadError())
     {
-        free(output);
         LOG_ERR("fill_id failed with code: %d", getLastError());
         return NULL;
     }
@@ -137,7 +135,6 @@ NSVGshape* create_shape(chunkmap* map, char* id, long id_length) {
     int code = getLastError();
 
     if(isBadError()) {
-        free(output);
         LOG_ERR("fill_strokedash_array failed with code: %d", code);
         return NULL;
     }
@@ -157,7 +154,6 @@ NSVGshape* create_shape(chunkmap* map, char* id, long id_length) {
     fill_bounds(output->bounds, newbounds, BOUNDS_LENGTH);
 
     if (isBadError()) {
-        free(output);
         LOG_ERR("fill_bounds failed with: %d", getLastError());
         return NULL;
     }
@@ -167,10 +163,32 @@ NSVGshape* create_shape(chunkmap* map, char* id, long id_length) {
     return output;
 }
 
+typedef struct
+{
+    arena* allocator;
+    NSVGimage image;
+} nsvg_owner;
+
 NSVGimage* create_nsvgimage(float width, float height) {
-    NSVGimage* output = calloc(1, sizeof(NSVGimage));
+    nsvg_owner* owner = calloc(1, sizeof(nsvg_owner));
+    owner->allocator = create_arena();
+    NSVGimage* output = &owner->image;
     output->width = width;
     output->height = height;
     output->shapes = NULL;
     return output;
 }
+
+nsvg_owner* owner_of_nsvgimage(NSVGimage* image) {
+    return (nsvg_owner*)((char*)image - offsetof(nsvg_owner, image));
+}
+
+arena* nsvg_arena(NSVGimage* image) {
+    return owner_of_nsvgimage(image)->allocator;
+}
+
+void free_nsvgimage(NSVGimage* image) {
+    nsvg_owner* owner = owner_of_nsvgimage(image);
+    free_arena(owner->allocator);
+    free(owner);
+}
@@ -7,6 +7,7 @@
 #include "../image.h"
 #include "../chunkmap.h"
 #include "../utility/vec.h"
+#include "../utility/arena.h"
 
 enum mapping_consts {
     BEZIERCURVE_LENGTH = 8,
@@ -26,6 +27,10 @@ void fill_beziercurve(float* beziercurve,
     float control_x1, float control_y1, 
     float control_x2, float control_y2);
 
-NSVGpath* create_path(image input, vector2 start, vector2 end);
-NSVGshape* create_shape(chunkmap* map, char* id, long id_length);
+NSVGpath* create_path(arena* allocator, image input, vector2 start, vector2 end);
+NSVGshape* create_shape(arena* allocator, chunkmap* map, char* id, long id_length);
+
+// The image owns an arena that every shape and path in it comes from, free_nsvg drops them all at once
 NSVGimage* create_nsvgimage(float width, float height);
+arena* nsvg_arena(NSVGimage* image);
+void free_nsvgimage(NSVGimage* image);
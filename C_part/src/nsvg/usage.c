@@ -9,6 +9,7 @@
 #include "usage.h"
 #include "../image.h"
 #include "../chunkmap.h"
+#include "../simplify.h"
 #include "../utility/error.h"
 #include "copy.h"
 #include "mapping.h"
@@ -19,17 +20,34 @@
 #include "bobsweep.h"
 #include "../utility/logger.h"
 
-//entry point of the file
-NSVGimage* dcdfill_for_nsvg(image input, vectorize_options options) {
-	quantize_image(&input, options.num_colours);
+// Quantizes input and builds its chunkmap. With a palette and one pixel per chunk the map also gets the palette indices.
+// options.quantize_chunks leaves input alone and quantizes the chunk averages as they are made instead.
+chunkmap* quantize_into_chunkmap(image* input, vectorize_options options) {
+    if(options.quantize_chunks) {
+        LOG_INFO("generating quantized chunkmap");
+        return generate_chunkmap(*input, options);
+    }
+    indexed_image indexed = quantize_image_keeping_indices(input, options);
 
-	if(isBadError()) {
-		LOG_ERR("quantize_image failed with %d", getLastError());
-		return getAndResetErrorCode();
-	}
+    if(isBadError()) {
+        LOG_ERR("quantize_image failed with %d", getLastError());
+        return NULL;
+    }
 
     LOG_INFO("generating chunkmap");
-    chunkmap* map = generate_chunkmap(input, options);
+    chunkmap* map = generate_chunkmap(*input, options);
+
+    if(!isBadError() && indexed.indices && options.chunk_size == 1) {
+        set_chunk_palette(map, indexed);
+    }
+    free_indexed_image(indexed);
+    free_palette(indexed.palette);
+    return map;
+}
+
+//entry point of the file
+NSVGimage* dcdfill_for_nsvg(image input, vectorize_options options) {
+    chunkmap* map = quantize_into_chunkmap(&input, options);
     
     if (isBadError())
     {
@@ -37,22 +55,32 @@ NSVGimage* dcdfill_for_nsvg(image input, vectorize_options options) {
         free_chunkmap(map);
         return NULL;
     }
+    return dcdfill_chunkmap_for_nsvg(map, options);
+}
 
+void dcdfill_find_shapes(chunkmap* map, vectorize_options options) {
     LOG_INFO("filling chunkmap");
     fill_chunkmap(map, &options);
     
     if (isBadError())
     {
         LOG_ERR("fill_chunkmap failed with code %d", getLastError());
-        free_chunkmap(map);
-        return NULL;
+        return;
     }
 
     LOG_INFO("sorting boundaries");
-    sort_boundary(map);
+    sort_boundary(map, options.thread_count);
 
     if(isBadError()) {
         LOG_ERR("sort_boundary failed with code %d", getLastError());
+    }
+}
+
+NSVGimage* dcdfill_chunkmap_for_nsvg(chunkmap* map, vectorize_options options) {
+    dcdfill_find_shapes(map, options);
+
+    if (isBadError())
+    {
         free_chunkmap(map);
         return NULL;
     }
@@ -68,7 +96,7 @@ NSVGimage* dcdfill_for_nsvg(image input, vectorize_options options) {
 
     LOG_INFO("iterating chunk shapes");
     NSVGimage* output = create_nsvgimage(map->map_width, map->map_height);
-    parse_map_into_nsvgimage(map, output);
+    parse_map_into_nsvgimage(map, output, options.thread_count);
     
     if (isBadError())
     {
@@ -82,25 +110,30 @@ NSVGimage* dcdfill_for_nsvg(image input, vectorize_options options) {
 }
 
 NSVGimage* bobsweep_for_nsvg(image input, vectorize_options options) {
-    quantize_image(&input, options.num_colours);
-
-	if(isBadError()) {
-		LOG_ERR("quantize_image failed with %d", getLastError());
-		return NULL;
-	}
-
-    chunkmap* map = generate_chunkmap(input, options);
+    chunkmap* map = quantize_into_chunkmap(&input, options);
 
     if (isBadError()) {
         LOG_ERR("generate_chunkmap failed with code: %d ", getLastError());
         free_chunkmap(map);
         return NULL;
     }
-    sweepfill_chunkmap(map, options.shape_colour_threshhold);
+    return bobsweep_chunkmap_for_nsvg(map, options);
+}
+
+void bobsweep_find_shapes(chunkmap* map, vectorize_options options) {
+    sweepfill_chunkmap(map, options.shape_colour_threshhold, options.thread_count);
 
     if (isBadError())
     {
         LOG_ERR("bobsweep failed with error: %d", getLastError());
+    }
+}
+
+NSVGimage* bobsweep_chunkmap_for_nsvg(chunkmap* map, vectorize_options options) {
+    bobsweep_find_shapes(map, options);
+
+    if (isBadError())
+    {
         free_chunkmap(map);
         return NULL;
     }
@@ -121,7 +154,7 @@ NSVGimage* bobsweep_for_nsvg(image input, vectorize_options options) {
     }
 
     NSVGimage* nsvg = create_nsvgimage(map->map_width, map->map_height);
-    parse_map_into_nsvgimage(map, nsvg);
+    parse_map_into_nsvgimage(map, nsvg, options.thread_count);
 
     if (isBadError())
     {
@@ -140,22 +173,5 @@ void free_nsvg(NSVGimage* input) {
         LOG_INFO("input is null");
         return;
     }
-
-    while(input->shapes != NULL) {
-        NSVGpath* currentpath = input->shapes->paths;
-
-        while(currentpath != NULL) {
-            if (currentpath->pts){
-                free(currentpath->pts);
-            }
-                
-            NSVGpath* nextpath = currentpath->next;
-            free(currentpath);
-            currentpath = nextpath;
-        }        
-        NSVGshape* nextshape = input->shapes->next;
-        free(input->shapes);
-        input->shapes = nextshape;
-    }
-    free(input);
+    free_nsvgimage(input); //every shape and path came from the image's arena
 }
@@ -9,5 +9,15 @@
 
 NSVGimage* dcdfill_for_nsvg(image input, vectorize_options options);
 NSVGimage* bobsweep_for_nsvg(image input, vectorize_options options);
+
+// The same pipelines from a chunkmap that is already quantized, they take the map over and free it
+NSVGimage* dcdfill_chunkmap_for_nsvg(chunkmap* map, vectorize_options options);
+NSVGimage* bobsweep_chunkmap_for_nsvg(chunkmap* map, vectorize_options options);
+
+// The first half of each pipeline: fills in map->shape_list with every shape's boundary in drawing order
+typedef void (*shape_finder)(chunkmap* map, vectorize_options options);
+void dcdfill_find_shapes(chunkmap* map, vectorize_options options);
+void bobsweep_find_shapes(chunkmap* map, vectorize_options options);
+
 void free_nsvg(NSVGimage* input);
 
@@ -0,0 +1,512 @@
+#include "palette.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "utility/logger.h"
+#include "utility/error.h"
+#include "utility/workers.h"
+
+enum {
+    HISTOGRAM_STRIP_ROWS = 64 //rows per histogram task, the workers steal strips from each other
+};
+
+// Every pixel that fell into one cell of the histogram
+typedef struct
+{
+    uint64_t count;
+    uint64_t sums[3];
+} histogram_cell;
+
+// A box of cells, min and max are inclusive cell coordinates per channel
+typedef struct
+{
+    int min[3];
+    int max[3];
+    uint64_t count;
+    uint64_t sums[3];
+} colour_box;
+
+typedef struct
+{
+    image input;
+    histogram_cell** worker_histograms; //one per worker so they never share a cell
+} histogram_stuff;
+
+typedef struct
+{
+    palette* colours;
+    histogram_cell* histogram;
+} lookup_stuff;
+
+typedef struct
+{
+    image input;
+    indexed_image output;
+} indexing_stuff;
+
+int get_palette_cell(pixel colour)
+{
+    int shift = 8 - PALETTE_CELL_BITS;
+    return ((colour.r >> shift) << (PALETTE_CELL_BITS * 2)) | ((colour.g >> shift) << PALETTE_CELL_BITS) | (colour.b >> shift);
+}
+
+int cell_index(int r, int g, int b)
+{
+    return (r << (PALETTE_CELL_BITS * 2)) | (g << PALETTE_CELL_BITS) | b;
+}
+
+int colour_distance(pixel a, pixel b)
+{
+    int r = (int)a.r - (int)b.r;
+    int g = (int)a.g - (int)b.g;
+    int b_difference = (int)a.b - (int)b.b;
+    return r * r + g * g + b_difference * b_difference;
+}
+
+int nearest_colour(palette* colours, pixel subject)
+{
+    int nearest = 0;
+    int nearest_distance = colour_distance(colours->colours[0], subject);
+
+    for (int i = 1; i < colours->count; ++i)
+    {
+        int distance = colour_distance(colours->colours[i], subject);
+
+        if (distance < nearest_distance)
+        {
+            nearest = i;
+            nearest_distance = distance;
+        }
+    }
+    return nearest;
+}
+
+pixel average_of(uint64_t count, const uint64_t sums[3])
+{
+    return (pixel){
+        (byte)((sums[0] + count / 2) / count),
+        (byte)((sums[1] + count / 2) / count),
+        (byte)((sums[2] + count / 2) / count)
+    };
+}
+
+void histogram_strip(void* userdata, int task, int worker)
+{
+    histogram_stuff* stuff = userdata;
+    histogram_cell* histogram = stuff->worker_histograms[worker];
+    int end = (task + 1) * HISTOGRAM_STRIP_ROWS;
+
+    if (end > stuff->input.height)
+        end = stuff->input.height;
+
+    for (int y = task * HISTOGRAM_STRIP_ROWS; y < end; ++y)
+    {
+        pixel* row = get_image_row(stuff->input, y);
+
+        for (int x = 0; x < stuff->input.width; ++x)
+        {
+            histogram_cell* cell = &histogram[get_palette_cell(row[x])];
+            ++cell->count;
+            cell->sums[0] += row[x].r;
+            cell->sums[1] += row[x].g;
+            cell->sums[2] += row[x].b;
+        }
+    }
+}
+
+// Counts are integers, so merging the workers gives the same histogram whatever the thread count
+histogram_cell* build_histogram(image input, int thread_count)
+{
+    int worker_count = thread_count > 1 ? thread_count : 1;
+    int strip_count = (input.height + HISTOGRAM_STRIP_ROWS - 1) / HISTOGRAM_STRIP_ROWS;
+    histogram_cell** worker_histograms = calloc(worker_count, sizeof(histogram_cell*));
+    bool allocated = worker_histograms != NULL;
+
+    for (int i = 0; i < worker_count && allocated; ++i)
+    {
+        worker_histograms[i] = calloc(PALETTE_CELLS, sizeof(histogram_cell));
+        allocated = worker_histograms[i] != NULL;
+    }
+
+    if (!allocated)
+    {
+        LOG_ERR("could not allocate colour histograms for %d workers", worker_count);
+        setError(ASSUMPTION_WRONG);
+
+        for (int i = 0; worker_histograms && i < worker_count; ++i)
+            free(worker_histograms[i]);
+
+        free(worker_histograms);
+        return NULL;
+    }
+
+    histogram_stuff stuff = { input, worker_histograms };
+    run_tasks(thread_count, strip_count, NULL, histogram_strip, &stuff);
+
+    histogram_cell* histogram = worker_histograms[0];
+
+    for (int i = 1; i < worker_count; ++i)
+    {
+        for (int cell = 0; cell < PALETTE_CELLS; ++cell)
+        {
+            histogram[cell].count += worker_histograms[i][cell].count;
+
+            for (int c = 0; c < 3; ++c)
+                histogram[cell].sums[c] += worker_histograms[i][cell].sums[c];
+        }
+        free(worker_histograms[i]);
+    }
+    free(worker_histograms);
+    return histogram;
+}
+
+// Shrinks the box onto the cells inside it that have pixels, and totals them up
+void fit_box(colour_box* box, histogram_cell* histogram)
+{
+    int min[3] = { box->max[0], box->max[1], box->max[2] };
+    int max[3] = { box->min[0], box->min[1], box->min[2] };
+    box->count = 0;
+    memset(box->sums, 0, sizeof(box->sums));
+
+    for (int r = box->min[0]; r <= box->max[0]; ++r)
+    {
+        for (int g = box->min[1]; g <= box->max[1]; ++g)
+        {
+            for (int b = box->min[2]; b <= box->max[2]; ++b)
+            {
+                histogram_cell* cell = &histogram[cell_index(r, g, b)];
+
+                if (!cell->count)
+                    continue;
+
+                int position[3] = { r, g, b };
+
+                for (int c = 0; c < 3; ++c)
+                {
+                    min[c] = position[c] < min[c] ? position[c] : min[c];
+                    max[c] = position[c] > max[c] ? position[c] : max[c];
+                    box->sums[c] += cell->sums[c];
+                }
+                box->count += cell->count;
+            }
+        }
+    }
+
+    if (box->count)
+    {
+        memcpy(box->min, min, sizeof(min));
+        memcpy(box->max, max, sizeof(max));
+    }
+}
+
+// Splits the box across its longest side where half of its pixels are on either side
+void split_box(colour_box* box, colour_box* other_half, histogram_cell* histogram)
+{
+    int axis = 0;
+
+    for (int c = 1; c < 3; ++c)
+    {
+        if (box->max[c] - box->min[c] > box->max[axis] - box->min[axis])
+            axis = c;
+    }
+    uint64_t slices[1 << PALETTE_CELL_BITS] = { 0 };
+
+    for (int r = box->min[0]; r <= box->max[0]; ++r)
+    {
+        for (int g = box->min[1]; g <= box->max[1]; ++g)
+        {
+            for (int b = box->min[2]; b <= box->max[2]; ++b)
+            {
+                int position[3] = { r, g, b };
+                slices[position[axis]] += histogram[cell_index(r, g, b)].count;
+            }
+        }
+    }
+    // the last slice always goes to the other half, so neither half ends up empty
+    int split = box->min[axis];
+    uint64_t below = slices[split];
+
+    while (split + 1 < box->max[axis] && below * 2 < box->count)
+    {
+        ++split;
+        below += slices[split];
+    }
+    *other_half = *box;
+    box->max[axis] = split;
+    other_half->min[axis] = split + 1;
+    fit_box(box, histogram);
+    fit_box(other_half, histogram);
+}
+
+int box_can_split(colour_box* box)
+{
+    return box->max[0] > box->min[0] || box->max[1] > box->min[1] || box->max[2] > box->min[2];
+}
+
+int median_cut(histogram_cell* histogram, int num_colours, palette* output)
+{
+    colour_box* boxes = calloc(num_colours, sizeof(colour_box));
+
+    if (!boxes)
+    {
+        LOG_ERR("could not allocate %d colour boxes", num_colours);
+        setError(ASSUMPTION_WRONG);
+        return 0;
+    }
+    boxes[0] = (colour_box){
+        { 0, 0, 0 },
+        { (1 << PALETTE_CELL_BITS) - 1, (1 << PALETTE_CELL_BITS) - 1, (1 << PALETTE_CELL_BITS) - 1 },
+        0,
+        { 0, 0, 0 }
+    };
+    fit_box(&boxes[0], histogram);
+    int box_count = 1;
+
+    while (box_count < num_colours)
+    {
+        // the most crowded box that still spans more than one cell
+        int biggest = -1;
+
+        for (int i = 0; i < box_count; ++i)
+        {
+            if (box_can_split(&boxes[i]) && (biggest < 0 || boxes[i].count > boxes[biggest].count))
+                biggest = i;
+        }
+
+        if (biggest < 0)
+            break;
+
+        split_box(&boxes[biggest], &boxes[box_count], histogram);
+        ++box_count;
+    }
+
+    for (int i = 0; i < box_count; ++i)
+        output->colours[i] = average_of(boxes[i].count, boxes[i].sums);
+
+    output->count = box_count;
+    free(boxes);
+    return box_count;
+}
+
+// Moves every palette colour to the average of the histogram cells nearest to it
+void refine_palette(histogram_cell* histogram, palette* colours, int iterations)
+{
+    for (int iteration = 0; iteration < iterations; ++iteration)
+    {
+        histogram_cell clusters[MAX_PALETTE_COLOURS] = { 0 };
+
+        for (int i = 0; i < PALETTE_CELLS; ++i)
+        {
+            if (!histogram[i].count)
+                continue;
+
+            histogram_cell* cluster = &clusters[nearest_colour(colours, average_of(histogram[i].count, histogram[i].sums))];
+            cluster->count += histogram[i].count;
+
+            for (int c = 0; c < 3; ++c)
+                cluster->sums[c] += histogram[i].sums[c];
+        }
+        int moved = 0;
+
+        for (int i = 0; i < colours->count; ++i)
+        {
+            if (!clusters[i].count)
+                continue; //nothing is nearest, the colour stays where median cut put it
+
+            pixel centre = average_of(clusters[i].count, clusters[i].sums);
+            moved |= memcmp(&centre, &colours->colours[i], sizeof(pixel)) != 0;
+            colours->colours[i] = centre;
+        }
+
+        if (!moved)
+            break;
+    }
+}
+
+// Cells with pixels in them use the average of those pixels, empty ones or all of them without a histogram use their centre
+void fill_lookup_slices(void* userdata, int band_start, int band_end)
+{
+    lookup_stuff* stuff = userdata;
+    int half_cell = 1 << (7 - PALETTE_CELL_BITS);
+
+    for (int r = band_start; r < band_end; ++r)
+    {
+        for (int g = 0; g < 1 << PALETTE_CELL_BITS; ++g)
+        {
+            for (int b = 0; b < 1 << PALETTE_CELL_BITS; ++b)
+            {
+                int index = cell_index(r, g, b);
+                histogram_cell* cell = stuff->histogram ? &stuff->histogram[index] : NULL;
+                int shift = 8 - PALETTE_CELL_BITS;
+                pixel colour = cell && cell->count ? average_of(cell->count, cell->sums) : (pixel){
+                    (byte)((r << shift) + half_cell), (byte)((g << shift) + half_cell), (byte)((b << shift) + half_cell)
+                };
+                stuff->colours->lookup[index] = (byte)nearest_colour(stuff->colours, colour);
+            }
+        }
+    }
+}
+
+palette* create_palette(image input, int num_colours, int kmeans_iterations, int thread_count)
+{
+    if (!input.pixels || input.width < 1 || input.height < 1)
+    {
+        LOG_ERR("Invalid dimensions or bad image");
+        setError(ASSUMPTION_WRONG);
+        return NULL;
+    }
+
+    if (num_colours < 1 || num_colours > MAX_PALETTE_COLOURS)
+    {
+        LOG_ERR("palettes hold 1 to %d colours, asked for %d", MAX_PALETTE_COLOURS, num_colours);
+        setError(BAD_ARGUMENT_ERROR);
+        return NULL;
+    }
+    palette* output = calloc(1, sizeof(palette));
+
+    if (!output)
+    {
+        LOG_ERR("could not allocate palette");
+        setError(ASSUMPTION_WRONG);
+        return NULL;
+    }
+    LOG_INFO("building colour histogram with %d threads", thread_count);
+    histogram_cell* histogram = build_histogram(input, thread_count);
+    int found = histogram ? median_cut(histogram, num_colours, output) : 0;
+
+    if (!found)
+    {
+        LOG_ERR("could not find the colours of the palette: %d", getLastError());
+        free(histogram);
+        free(output);
+        return NULL;
+    }
+    LOG_INFO("median cut found %d colours, refining with up to %d k-means iterations", found, kmeans_iterations);
+    refine_palette(histogram, output, kmeans_iterations);
+
+    lookup_stuff stuff = { output, histogram };
+    run_in_bands(thread_count, 1 << PALETTE_CELL_BITS, fill_lookup_slices, &stuff);
+    free(histogram);
+    return output;
+}
+
+palette* create_palette_from_colours(const pixel* colours, int count, int thread_count)
+{
+    if (!colours || count < 1 || count > MAX_PALETTE_COLOURS)
+    {
+        LOG_ERR("palettes hold 1 to %d colours, given %d", MAX_PALETTE_COLOURS, count);
+        setError(BAD_ARGUMENT_ERROR);
+        return NULL;
+    }
+    palette* output = calloc(1, sizeof(palette));
+
+    if (!output)
+    {
+        LOG_ERR("could not allocate palette");
+        setError(ASSUMPTION_WRONG);
+        return NULL;
+    }
+    output->count = count;
+    memcpy(output->colours, colours, count * sizeof(pixel));
+
+    lookup_stuff stuff = { output, NULL };
+    run_in_bands(thread_count, 1 << PALETTE_CELL_BITS, fill_lookup_slices, &stuff);
+    return output;
+}
+
+void free_palette(palette* subject)
+{
+    free(subject);
+}
+
+void index_rows(void* userdata, int band_start, int band_end)
+{
+    indexing_stuff* stuff = userdata;
+    byte* lookup = stuff->output.palette->lookup;
+
+    for (int y = band_start; y < band_end; ++y)
+    {
+        pixel* row = get_image_row(stuff->input, y);
+        byte* indices = &stuff->output.indices[(size_t)y * stuff->output.stride];
+
+        for (int x = 0; x < stuff->input.width; ++x)
+            indices[x] = lookup[get_palette_cell(row[x])];
+    }
+}
+
+indexed_image create_indexed_image(image input, palette* colours, int thread_count)
+{
+    if (!input.pixels || !colours)
+    {
+        LOG_ERR("can not index an image without pixels or a palette");
+        setError(NULL_ARGUMENT_ERROR);
+        return (indexed_image){ 0 };
+    }
+    indexed_image output = {
+        input.width, input.height,
+        (input.width + IMAGE_ALIGNMENT - 1) / IMAGE_ALIGNMENT * IMAGE_ALIGNMENT,
+        NULL,
+        NULL
+    };
+    size_t size = (size_t)output.stride * output.height;
+    output.indices = allocate_aligned(size);
+    output.palette = colours;
+
+    if (!output.indices)
+    {
+        LOG_ERR("could not allocate %zu bytes for indexed image", size);
+        setError(ASSUMPTION_WRONG);
+        return (indexed_image){ 0 };
+    }
+    indexing_stuff stuff = { input, output };
+    run_in_bands(thread_count, input.height, index_rows, &stuff);
+    return output;
+}
+
+void free_indexed_image(indexed_image subject)
+{
+    if (subject.indices)
+        free_aligned(subject.indices);
+}
+
+void expand_rows(void* userdata, int band_start, int band_end)
+{
+    indexing_stuff* stuff = userdata;
+    pixel* colours = stuff->output.palette->colours;
+
+    for (int y = band_start; y < band_end; ++y)
+    {
+        pixel* row = get_image_row(stuff->input, y);
+        byte* indices = &stuff->output.indices[(size_t)y * stuff->output.stride];
+
+        for (int x = 0; x < stuff->output.width; ++x)
+            row[x] = colours[indices[x]];
+    }
+}
+
+void expand_indexed_image(indexed_image input, image output, int thread_count)
+{
+    if (output.width < input.width || output.height < input.height)
+    {
+        LOG_ERR("indexed image does not fit in the output image");
+        setError(BAD_ARGUMENT_ERROR);
+        return;
+    }
+    indexing_stuff stuff = { output, input };
+    run_in_bands(thread_count, input.height, expand_rows, &stuff);
+}
+
+void fill_similarity_matrix(const palette* colours, int limit, similarity_matrix* output)
+{
+    memset(output, 0, sizeof(similarity_matrix));
+
+    for (int a = 0; a < colours->count; ++a)
+    {
+        for (int b = 0; b < colours->count; ++b)
+        {
+            if (colour_distance(colours->colours[a], colours->colours[b]) <= limit)
+                output->rows[a][b >> 5] |= 1u << (b & 31);
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "image.h"
+
+enum palette_consts {
+    MAX_PALETTE_COLOURS = 256,
+    PALETTE_CELL_BITS = 5, //bits kept per channel by the histogram and the lookup table
+    PALETTE_CELLS = 1 << (PALETTE_CELL_BITS * 3)
+};
+
+// Up to 256 colours picked for one image, and which of them is nearest to every colour
+typedef struct
+{
+    int count;
+    pixel colours[MAX_PALETTE_COLOURS];
+    byte lookup[PALETTE_CELLS]; //palette index of the nearest colour for each 5 bit per channel cell
+} palette;
+
+// Every pixel is an index into palette, rows are stride bytes apart
+typedef struct
+{
+    int width;
+    int height;
+    int stride;
+    byte* indices;
+    palette* palette;
+} indexed_image;
+
+// Bit b of rows[a] is set when palette colours a and b are similar, so comparing two indexed colours is one lookup
+typedef struct
+{
+    uint32_t rows[MAX_PALETTE_COLOURS][MAX_PALETTE_COLOURS / 32];
+} similarity_matrix;
+
+int get_palette_cell(pixel colour);
+
+// Median cut over a histogram of the image, then kmeans_iterations rounds of k-means on the histogram cells
+palette* create_palette(image input, int num_colours, int kmeans_iterations, int thread_count);
+// A palette of colours that were picked already, like the one a png comes with
+palette* create_palette_from_colours(const pixel* colours, int count, int thread_count);
+void free_palette(palette* subject);
+
+// Looks every pixel up in the palette, the indexed image keeps a pointer to the palette but does not own it
+indexed_image create_indexed_image(image input, palette* colours, int thread_count);
+void free_indexed_image(indexed_image subject);
+
+// Writes the palette colour of every index back into output, which must be as big as the indexed image
+void expand_indexed_image(indexed_image input, image output, int thread_count);
+
+// Marks every pair of palette colours at most limit apart, squared, limit comes from similarity_limit
+void fill_similarity_matrix(const palette* colours, int limit, similarity_matrix* output);
+
+static inline int palette_colours_similar(const similarity_matrix* matrix, byte a, byte b)
+{
+    return (matrix->rows[a][b >> 5] >> (b & 31)) & 1;
+}
@@ -4,6 +4,9 @@
 #include "image.h"
 #include "utility/logger.h"
 #include "utility/error.h"
+#include "kernels.h"
+#include "utility/workers.h"
+#include "palette.h"
 
 const int TOTAL_COLOURS = 256;
 
@@ -29,23 +32,74 @@ byte quantize_int(int subject, int divisions) {
     return (byte)subject;
 }
 
-void quantize_image(image* subject, int num_colours) {
-    if(num_colours < 0 ||
+quantize_table create_quantize_table(int num_colours) {
+    quantize_table table;
+    table.divisions = TOTAL_COLOURS / num_colours;
+
+    for(int i = 0; i < TOTAL_COLOURS; ++i) {
+        table.values[i] = quantize_int(i, table.divisions);
+    }
+    return table;
+}
+
+typedef struct
+{
+    image* subject;
+    quantize_table* table;
+    const pixel_kernels* kernels;
+} quantize_band_stuff;
+
+void quantize_rows(void* userdata, int band_start, int band_end) {
+    quantize_band_stuff* stuff = userdata;
+
+    // every channel is quantized the same way, so a row is just width * 3 bytes
+    for(int y = band_start; y < band_end; ++y) {
+        stuff->kernels->quantize_bytes((byte*)get_image_row(*stuff->subject, y), (size_t)stuff->subject->width * 3, stuff->table);
+    }
+}
+
+// Swaps every pixel for the nearest colour of a palette made for this image
+indexed_image quantize_to_palette(image* subject, vectorize_options options) {
+    palette* colours = create_palette(*subject, options.num_colours, options.kmeans_iterations, options.thread_count);
+
+    if(isBadError()) {
+        LOG_ERR("create_palette failed with %d", getLastError());
+        return (indexed_image){ 0 };
+    }
+    indexed_image indexed = create_indexed_image(*subject, colours, options.thread_count);
+
+    if(isBadError()) {
+        LOG_ERR("create_indexed_image failed with %d", getLastError());
+        free_palette(colours);
+        return (indexed_image){ 0 };
+    }
+    expand_indexed_image(indexed, *subject, options.thread_count);
+    return indexed;
+}
+
+indexed_image quantize_image_keeping_indices(image* subject, vectorize_options options) {
+    int num_colours = options.num_colours;
+
+    if(num_colours < 1 ||
         num_colours > TOTAL_COLOURS) {
         LOG_ERR("num colours out of bounds!");
         setError(BAD_ARGUMENT_ERROR);
-        return;
+        return (indexed_image){ 0 };
     }
-    LOG_INFO("simplifying colour scheme to %d colours", num_colours);
-    int divisions = TOTAL_COLOURS / num_colours;
-
-    for(int x = 0; x < subject->width; ++x) {
-        for(int y = 0; y < subject->height; ++y) {
-            pixel* pix = &subject->pixels_array_2d[x][y];
-            pix->r = quantize_int(pix->r, divisions);
-            pix->g = quantize_int(pix->g, divisions);
-            pix->b = quantize_int(pix->b, divisions);
-        }
+
+    if(options.quantize_method == QUANTIZE_PALETTE) {
+        LOG_INFO("reducing image to a palette of %d colours with %d threads", num_colours, options.thread_count);
+        return quantize_to_palette(subject, options);
     }
+    LOG_INFO("simplifying colour scheme to %d colours with %d threads", num_colours, options.thread_count);
+    quantize_table table = create_quantize_table(num_colours);
+    quantize_band_stuff stuff = { subject, &table, get_pixel_kernels() };
+    run_in_bands(options.thread_count, subject->height, quantize_rows, &stuff);
+    return (indexed_image){ 0 };
 }
 
+void quantize_image(image* subject, vectorize_options options) {
+    indexed_image indexed = quantize_image_keeping_indices(subject, options);
+    free_indexed_image(indexed);
+    free_palette(indexed.palette);
+}
@@ -1,5 +1,25 @@
 #pragma once
 
 #include "image.h"
+#include "chunkmap.h"
+#include "palette.h"
 
-void quantize_image(image* subject, int num_colours);
+enum quantize_method {
+    QUANTIZE_CHANNELS, //snap every channel to a multiple of 256 / num_colours
+    QUANTIZE_PALETTE //pick num_colours colours for the image with median cut and k-means
+};
+
+// quantize_int of every byte value for one number of colours
+typedef struct
+{
+    int divisions;
+    byte values[256];
+} quantize_table;
+
+byte quantize_int(int subject, int divisions);
+quantize_table create_quantize_table(int num_colours);
+void quantize_image(image* subject, vectorize_options options);
+
+// quantize_image that also hands back the palette indices of QUANTIZE_PALETTE, which let later stages compare colours by index.
+// The indices are NULL for channel snapping, otherwise free both the indexed image and its palette.
+indexed_image quantize_image_keeping_indices(image* subject, vectorize_options options);
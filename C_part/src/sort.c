@@ -9,132 +9,155 @@
 #include "chunkmap.h"
 #include "utility/logger.h"
 #include "utility/error.h"
-#include "utility/vec.h"
-#include "prune.h"
-
-float M_POG = 3.1415926535897932;
+#include "utility/workers.h"
 
 enum {
-    ADJACENT_COUNT = 9
+    DIRECTION_COUNT = 8,
+    START_BACKTRACK = 0 //the chunk to the west of the starting chunk
 };
 
-void sort_item(pixelchunk** array, pixelchunk* current, unsigned long i, unsigned long next, unsigned long length) {
-    pixelchunk* inbetween = array[next];
-    array[next] = current;
-    array[i] = inbetween;
-}
-
-void dont_skip_corners(pixelchunk** array, unsigned long eligiblesubjects[ADJACENT_COUNT], pixelchunk* subject, pixelchunk* previous, 
-                        unsigned long eligible_count, unsigned long next, unsigned long length) {
+// Moore neighbourhood in clockwise order (y points down), starting from the west
+const int DIRECTION_X[DIRECTION_COUNT] = { -1, -1, 0, 1, 1, 1, 0, -1 };
+const int DIRECTION_Y[DIRECTION_COUNT] = { 0, -1, -1, -1, 0, 1, 1, 1 };
 
-    float smallest_angle = M_POG * 2.f; // set to largest possible radian to begin with
-    pixelchunk* most_eligible = NULL;
-    unsigned long most_eligible_index = 0;
+// Direction of an offset, indexed by [y offset + 1][x offset + 1]
+const int DIRECTION_OF[3][3] = {
+    { 1, 2, 3 },
+    { 0, -1, 4 },
+    { 7, 6, 5 }
+};
 
-    for (unsigned long q = 0; q < eligible_count; ++q) {
-        pixelchunk* eligible = array[eligiblesubjects[q]];
-        float angle = calculate_angle_between(eligible, subject, previous);
+// The walk never leaves the ghost ring around the map, whose chunks are in no shape
+bool chunk_in_shape(chunkmap* map, chunkshape* shape, int x, int y) {
+    return get_chunk(map, x, y)->shape_index == shape - map->shape_list;
+}
 
-        if (angle < smallest_angle)
-        {
-            smallest_angle = angle;
-            most_eligible = eligible;
-            most_eligible_index = eligiblesubjects[q];
+// Finds the next chunk clockwise around (x, y), searching from just after the backtrack neighbour.
+// Gives back the next chunk's position and its backtrack, the neighbour checked just before it, which is outside the shape
+bool moore_step(chunkmap* map, chunkshape* shape, int x, int y, int backtrack, int* next_x, int* next_y, int* next_backtrack) {
+    for (int i = 1; i <= DIRECTION_COUNT; ++i) {
+        int direction = (backtrack + i) % DIRECTION_COUNT;
+        int candidate_x = x + DIRECTION_X[direction];
+        int candidate_y = y + DIRECTION_Y[direction];
+
+        if (chunk_in_shape(map, shape, candidate_x, candidate_y)) {
+            int outside_direction = (direction + DIRECTION_COUNT - 1) % DIRECTION_COUNT;
+            int outside_x = x + DIRECTION_X[outside_direction];
+            int outside_y = y + DIRECTION_Y[outside_direction];
+            *next_x = candidate_x;
+            *next_y = candidate_y;
+            *next_backtrack = DIRECTION_OF[outside_y - candidate_y + 1][outside_x - candidate_x + 1];
+            return true;
         }
     }
+    return false; //a lone chunk
+}
 
-    if (most_eligible)
-    {
-        sort_item(array, most_eligible, most_eligible_index, next, length);
-    }
+// Moore-neighbour contour tracing: walks the outer boundary of a shape clockwise, one step per boundary chunk,
+// so every chunk in the output is adjacent to the one before it.
+// The walk starts from the shape's first chunk in scan order, whose west neighbour can never be in the shape,
+// and ends when leaving the start again would repeat the first step.
+// Gives back the length of the walk, and writes the chunk indices into traced unless it is NULL
+int trace_boundary(chunkmap* map, chunkshape* shape, int32_t* traced) {
+    int32_t start_index = map->boundary_indices[shape->boundaries_offset];
+    int start_x = start_index % map->map_width;
+    int start_y = start_index / map->map_width;
+    int traced_length = 0;
+
+    if (traced)
+        traced[traced_length] = start_index;
+    ++traced_length;
+
+    int first_x, first_y, first_backtrack;
+
+    if (!moore_step(map, shape, start_x, start_y, START_BACKTRACK, &first_x, &first_y, &first_backtrack))
+        return traced_length;
+
+    int x = first_x;
+    int y = first_y;
+    int backtrack = first_backtrack;
+    int max_steps = shape->chunks_amount * 4 + DIRECTION_COUNT;
+
+    for (int step = 0; step < max_steps; ++step) {
+        if (x == start_x && y == start_y) {
+            int next_x, next_y, next_backtrack;
+            moore_step(map, shape, x, y, backtrack, &next_x, &next_y, &next_backtrack);
+
+            if (next_x == first_x && next_y == first_y && next_backtrack == first_backtrack)
+                return traced_length;
+        }
 
-    else
-    {
-        return;
+        if (traced)
+            traced[traced_length] = x + y * map->map_width;
+        ++traced_length;
+        moore_step(map, shape, x, y, backtrack, &x, &y, &backtrack);
     }
+    LOG_ERR("boundary trace of shape starting at (%d, %d) did not close", start_x, start_y);
+    setError(ASSUMPTION_WRONG);
+    return traced_length;
 }
 
-void bubble_sort(pixelchunk** array, unsigned long start, unsigned long length) {
-    bool allsorted = false;
+typedef struct {
+    chunkmap* map;
+    int* traced_lengths;
+    int* traced_offsets;
+    int32_t* traced; //NULL while measuring
+} boundary_sort_stuff;
 
-    while(allsorted == false) {        
-        unsigned long next = start + 1;
-
-        if(next >= length) {
-            allsorted = true;
-            return;
-        }
-        unsigned long eligiblesubjects[ADJACENT_COUNT] = {0};
-        pixelchunk* subject = array[start];
-        unsigned long eligible_count = 0;
-        pixelchunk* previous = (start ? array[start - 1] : NULL);
-
-        for(unsigned long i = start; i < length; ++i) {
-            pixelchunk* current = array[i];
-
-            if(chunk_is_adjacent(current, subject)) {
-                if(previous == NULL) {
-                    sort_item(array, current, i, next, length);
-                    break;
-                }
-
-                else if(eligible_count == ADJACENT_COUNT) {
-                    LOG_ERR("adjacent chunks are larger than known size!");
-                    setError(ASSUMPTION_WRONG);
-                    return;
-                }
-                eligiblesubjects[eligible_count] = i;
-                ++eligible_count;            
-            }
-
-            else {
-
-            }
-
-            if(i == length - 1) 
-            {            
-                dont_skip_corners(array, eligiblesubjects, subject, previous, eligible_count, next, length);
-            }
-        }
-        ++start;
-    }
+bool can_trace(chunkshape* shape) {
+    return shape->boundaries_length > 0;
 }
 
-pixelchunk** convert_boundary_list_toarray(pixelchunk_list* holder, unsigned long length) {
-    pixelchunk** output = calloc(1, sizeof(pixelchunk*) * length);
-    pixelchunk_list* current = holder;
+// One shape per task, a shape only ever touches its own range of the output
+void trace_shape_boundary(void* userdata, int task, int worker) {
+    (void)worker;
+    boundary_sort_stuff* stuff = userdata;
+    chunkshape* shape = &stuff->map->shape_list[task];
 
-    for(unsigned long i = 0; i < length; ++i) {
-        output[i] = current->chunk_p;
-        current = current->next;
-    }
-    return output;
+    if (!can_trace(shape) || isBadError())
+        return;
+
+    int32_t* traced = stuff->traced ? stuff->traced + stuff->traced_offsets[task] : NULL;
+    stuff->traced_lengths[task] = trace_boundary(stuff->map, shape, traced);
 }
 
-void convert_array_to_boundary_list(pixelchunk** array, pixelchunk_list* output, unsigned long length) {
-    pixelchunk_list* current = output;
+// Traces every shape twice, once to measure and once to write into the new boundary array, so every shape knows its range up front
+void sort_boundary(chunkmap* map, int thread_count) {
+    int shape_count = map->shape_count;
+    int* sizes = calloc(shape_count, sizeof(int));
+    int* traced_lengths = calloc(shape_count * 2, sizeof(int));
+    int* traced_offsets = traced_lengths + shape_count;
 
-    for(unsigned long i = 0; i < length; ++i) {
-        current->chunk_p = array[i];
-        current = current->next;
-    }    
-}
+    for (int i = 0; i < shape_count; ++i)
+        sizes[i] = map->shape_list[i].boundaries_length;
 
-void sort_boundary(chunkmap* map) {
-    chunkshape* shape = map->shape_list;
+    boundary_sort_stuff stuff = { map, traced_lengths, traced_offsets, NULL };
+    run_tasks(thread_count, shape_count, sizes, trace_shape_boundary, &stuff);
+
+    if (isBadError()) {
+        LOG_ERR("trace_boundary failed with code: %d", getLastError());
+        free(traced_lengths);
+        free(sizes);
+        return;
+    }
+    int traced_total = 0;
+
+    for (int i = 0; i < shape_count; ++i) {
+        traced_offsets[i] = traced_total;
+        traced_total += traced_lengths[i];
+    }
+    stuff.traced = arena_alloc(map->allocator, sizeof(int32_t) * (traced_total ? traced_total : 1));
+    run_tasks(thread_count, shape_count, traced_lengths, trace_shape_boundary, &stuff);
 
-    while (shape)
-    {
-        pixelchunk** array = convert_boundary_list_toarray(shape->boundaries, shape->boundaries_length);
-        bubble_sort(array, 0, shape->boundaries_length);
+    for (int i = 0; i < shape_count; ++i) {
+        chunkshape* shape = &map->shape_list[i];
 
-        if(isBadError()) {
-            LOG_ERR("bubble_sort failed with code: %d", getLastError());
-            return;
+        if (can_trace(shape)) {
+            shape->boundaries_offset = traced_offsets[i];
+            shape->boundaries_length = traced_lengths[i];
         }
-        convert_array_to_boundary_list(array, shape->boundaries, shape->boundaries_length);
-        prune_boundary(shape->boundaries);       
-        shape = shape->next;
-        free(array);
     }
+    map->boundary_indices = stuff.traced; //the unsorted indices stay in the arena until the map is freed
+    free(traced_lengths);
+    free(sizes);
 }
@@ -2,5 +2,4 @@
 
 #include "chunkmap.h"
 
-void bubble_sort(pixelchunk** array,unsigned long start, unsigned long length);
-void sort_boundary(chunkmap* map);
+void sort_boundary(chunkmap* map, int thread_count);
@@ -0,0 +1,157 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "logger.h"
+#include "error.h"
+
+enum arena_consts {
+    ARENA_ALIGNMENT = 16,
+    ARENA_FIRST_BLOCK_SIZE = 64 * 1024,
+    ARENA_MAX_BLOCK_SIZE = 16 * 1024 * 1024
+};
+
+typedef struct arena_block
+{
+    struct arena_block* next;
+    size_t size;
+    size_t used;
+} arena_block;
+
+size_t align_arena_size(size_t size)
+{
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+//the usable memory starts right after the header
+unsigned char* arena_block_data(arena_block* block)
+{
+    return (unsigned char*)block + align_arena_size(sizeof(arena_block));
+}
+
+arena* create_arena()
+{
+    arena* output = calloc(1, sizeof(arena));
+
+    if (!output)
+    {
+        LOG_ERR("could not allocate arena");
+        setError(ASSUMPTION_WRONG);
+        return NULL;
+    }
+    output->block_size = ARENA_FIRST_BLOCK_SIZE;
+    return output;
+}
+
+arena_block* add_arena_block(arena* allocator, size_t min_size)
+{
+    size_t size = allocator->block_size;
+
+    if (size < min_size)
+        size = min_size;
+
+    arena_block* block = malloc(align_arena_size(sizeof(arena_block)) + size);
+
+    if (!block)
+    {
+        LOG_ERR("could not allocate arena block of %zu bytes", size);
+        setError(ASSUMPTION_WRONG);
+        return NULL;
+    }
+    block->size = size;
+    block->used = 0;
+    block->next = allocator->blocks;
+    allocator->blocks = block;
+
+    if (allocator->block_size < ARENA_MAX_BLOCK_SIZE)
+        allocator->block_size *= 2;
+
+    return block;
+}
+
+void* arena_alloc(arena* allocator, size_t size)
+{
+    size = align_arena_size(size ? size : 1);
+    arena_block* block = allocator->blocks;
+
+    if (!block || block->size - block->used < size)
+    {
+        block = add_arena_block(allocator, size);
+
+        if (!block)
+            return NULL;
+    }
+    void* output = arena_block_data(block) + block->used;
+    block->used += size;
+    memset(output, 0, size);
+    return output;
+}
+
+void reset_arena(arena* allocator)
+{
+    if (!allocator)
+        return;
+
+    arena_block* biggest = NULL;
+    arena_block* block = allocator->blocks;
+
+    while (block)
+    {
+        arena_block* next = block->next;
+
+        if (!biggest || block->size > biggest->size)
+        {
+            free(biggest);
+            biggest = block;
+        }
+
+        else
+        {
+            free(block);
+        }
+        block = next;
+    }
+
+    if (biggest)
+    {
+        biggest->used = 0;
+        biggest->next = NULL;
+    }
+    allocator->blocks = biggest;
+}
+
+void free_arena(arena* allocator)
+{
+    if (!allocator)
+        return;
+
+    reset_arena(allocator);
+    free(allocator->blocks);
+    free(allocator);
+}
+
+void merge_arenas(arena* into, arena* from)
+{
+    if (!from->blocks)
+        return;
+
+    //the merged blocks go behind into's newest block so it keeps filling up its own free space
+    arena_block* last = from->blocks;
+
+    while (last->next)
+        last = last->next;
+
+    if (into->blocks)
+    {
+        last->next = into->blocks->next;
+        into->blocks->next = from->blocks;
+    }
+
+    else
+    {
+        last->next = NULL;
+        into->blocks = from->blocks;
+    }
+    from->blocks = NULL;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+
+struct arena_block;
+
+// Bump allocator for the many small objects one vectorizing job creates.
+// Nothing is freed on its own, everything goes at once with reset_arena or free_arena.
+typedef struct
+{
+    struct arena_block* blocks; //newest block first, allocations come from its unused tail
+    size_t block_size; //size of the next block, doubles every block up to ARENA_MAX_BLOCK_SIZE
+} arena;
+
+arena* create_arena();
+void free_arena(arena* allocator);
+
+// Zeroed memory that lives until the arena is reset
+void* arena_alloc(arena* allocator, size_t size);
+
+// Drops every allocation but keeps the biggest block around for the next job
+void reset_arena(arena* allocator);
+
+// Hands every block of from over to into, leaving from empty. Lets workers allocate from their own arena and give the results to one owner.
+void merge_arenas(arena* into, arena* from);
@@ -1,25 +1,56 @@
 #include "error.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
 #include "logger.h"
 
-int error_code = SUCCESS_CODE;
+// Workers set and check the error while other workers do too, so it is only ever touched atomically
+#ifdef _WIN32
+typedef volatile LONG error_slot;
+
+int load_error(error_slot* slot)
+{
+    return InterlockedCompareExchange(slot, 0, 0);
+}
+
+int exchange_error(error_slot* slot, int error)
+{
+    return InterlockedExchange(slot, error);
+}
+
+#else
+typedef volatile int error_slot;
+
+int load_error(error_slot* slot)
+{
+    return __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+}
+
+int exchange_error(error_slot* slot, int error)
+{
+    return __atomic_exchange_n(slot, error, __ATOMIC_ACQ_REL);
+}
+#endif
+
+error_slot error_code = SUCCESS_CODE;
 
 int isBadError() {
-    return error_code != SUCCESS_CODE;
+    return load_error(&error_code) != SUCCESS_CODE;
 }
 
 int getLastError() {
-    return error_code;
+    return load_error(&error_code);
 }
 
 void setError(int error) {
     LOG_INFO("setting status code: %d", error);
-    error_code = error;
+    exchange_error(&error_code, error);
 }
 
 int getAndResetErrorCode()
 {
-    int tmp = getLastError();
-    setError(SUCCESS_CODE);
-    return tmp;
+    LOG_INFO("setting status code: %d", SUCCESS_CODE);
+    return exchange_error(&error_code, SUCCESS_CODE);
 }
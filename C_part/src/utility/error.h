@@ -11,7 +11,8 @@ enum vectorizing_opcodes {
     OVERFLOW_ERROR,
     BAD_ARGUMENT_ERROR,
     NOT_PNG,
-    LOW_BOUNDARIES_CREATED
+    LOW_BOUNDARIES_CREATED,
+    NOT_JPEG
 };
 
 int isBadError();
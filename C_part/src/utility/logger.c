@@ -4,9 +4,26 @@
 #include <time.h>
 #include <stdarg.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
 FILE* logfile = 0;
 const char* LOG_PATH = "log.txt";
 
+// The parallel stages log from several threads, one message is written at a time
+#ifdef _WIN32
+SRWLOCK log_lock = SRWLOCK_INIT;
+#define LOCK_LOG() AcquireSRWLockExclusive(&log_lock)
+#define UNLOCK_LOG() ReleaseSRWLockExclusive(&log_lock)
+#else
+pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK_LOG() pthread_mutex_lock(&log_lock)
+#define UNLOCK_LOG() pthread_mutex_unlock(&log_lock)
+#endif
+
 
 void open_log(char* filename)
 {
@@ -24,13 +41,18 @@ void close_log()
 }
 
 void clear_logfile() {
+    LOCK_LOG();
+
     if(logfile) {
         close_log();
     }
     open_log(LOG_PATH);
+    UNLOCK_LOG();
 }
 
 void logger(const char* tag, const char* message, ...) {
+    LOCK_LOG();
+
     if (!logfile)
     {
         open_log(LOG_PATH);
@@ -59,4 +81,5 @@ void logger(const char* tag, const char* message, ...) {
 #endif
 
     va_end(args);
+    UNLOCK_LOG();
 }
@@ -0,0 +1,104 @@
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "error.h"
+#include "logger.h"
+
+#ifdef _WIN32
+mapped_file map_file(const char* path)
+{
+    if (!path)
+    {
+        LOG_ERR("path not given");
+        setError(NULL_ARGUMENT_ERROR);
+        return (mapped_file){ 0 };
+    }
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        LOG_ERR("Could not open file '%s' for reading", path);
+        setError(ASSUMPTION_WRONG);
+        return (mapped_file){ 0 };
+    }
+    LARGE_INTEGER size;
+    HANDLE mapping = NULL;
+    const void* view = NULL;
+
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+    if (mapping)
+        view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+    // the view keeps the file open by itself
+    if (mapping)
+        CloseHandle(mapping);
+
+    CloseHandle(file);
+
+    if (!view)
+    {
+        LOG_ERR("could not map file '%s'", path);
+        setError(READ_FILE_ERROR);
+        return (mapped_file){ 0 };
+    }
+    LOG_INFO("mapped %zu bytes of '%s'", (size_t)size.QuadPart, path);
+    return (mapped_file){ view, (size_t)size.QuadPart };
+}
+
+void unmap_file(mapped_file file)
+{
+    if (file.data)
+        UnmapViewOfFile(file.data);
+}
+#else
+mapped_file map_file(const char* path)
+{
+    if (!path)
+    {
+        LOG_ERR("path not given");
+        setError(NULL_ARGUMENT_ERROR);
+        return (mapped_file){ 0 };
+    }
+    int file = open(path, O_RDONLY);
+
+    if (file < 0)
+    {
+        LOG_ERR("Could not open file '%s' for reading", path);
+        setError(ASSUMPTION_WRONG);
+        return (mapped_file){ 0 };
+    }
+    struct stat status;
+    void* view = MAP_FAILED;
+
+    if (fstat(file, &status) == 0 && status.st_size > 0)
+        view = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+
+    close(file); //the mapping keeps the file open by itself
+
+    if (view == MAP_FAILED)
+    {
+        LOG_ERR("could not map file '%s'", path);
+        setError(READ_FILE_ERROR);
+        return (mapped_file){ 0 };
+    }
+    madvise(view, (size_t)status.st_size, MADV_SEQUENTIAL); //read further ahead, and let pages go once they are behind
+    LOG_INFO("mapped %zu bytes of '%s'", (size_t)status.st_size, path);
+    return (mapped_file){ view, (size_t)status.st_size };
+}
+
+void unmap_file(mapped_file file)
+{
+    if (file.data)
+        munmap((void*)file.data, file.length);
+}
+#endif
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A whole file mapped read only into memory, its pages are read in as they are touched
+typedef struct
+{
+    const uint8_t* data; //NULL when the file could not be mapped
+    size_t length;
+} mapped_file;
+
+// Maps the file, and tells the kernel it will be read from front to back
+mapped_file map_file(const char* path);
+void unmap_file(mapped_file file);
@@ -0,0 +1,286 @@
+#include "workers.h"
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "logger.h"
+
+typedef struct
+{
+    band_job job;
+    void* userdata;
+    int band_start;
+    int band_end;
+} band;
+
+#ifdef _WIN32
+typedef HANDLE worker_thread;
+
+DWORD WINAPI run_band(LPVOID data)
+{
+    band* subject = data;
+    subject->job(subject->userdata, subject->band_start, subject->band_end);
+    return 0;
+}
+
+int start_worker(worker_thread* thread, band* subject)
+{
+    *thread = CreateThread(NULL, 0, run_band, subject, 0, NULL);
+    return *thread != NULL;
+}
+
+void join_worker(worker_thread thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+#else
+typedef pthread_t worker_thread;
+
+void* run_band(void* data)
+{
+    band* subject = data;
+    subject->job(subject->userdata, subject->band_start, subject->band_end);
+    return NULL;
+}
+
+int start_worker(worker_thread* thread, band* subject)
+{
+    return pthread_create(thread, NULL, run_band, subject) == 0;
+}
+
+void join_worker(worker_thread thread)
+{
+    pthread_join(thread, NULL);
+}
+#endif
+
+int get_core_count()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count < 1 ? 1 : (int)count;
+#endif
+}
+
+void run_in_bands(int thread_count, int count, band_job job, void* userdata)
+{
+    if (count < 1)
+        return;
+
+    if (thread_count > count)
+        thread_count = count;
+
+    if (thread_count <= 1)
+    {
+        job(userdata, 0, count);
+        return;
+    }
+
+    band* bands = calloc(thread_count, sizeof(band));
+    worker_thread* threads = calloc(thread_count, sizeof(worker_thread));
+    int* started = calloc(thread_count, sizeof(int));
+
+    for (int i = 0; i < thread_count; ++i)
+    {
+        bands[i] = (band){
+            job, userdata,
+            (int)((long long)count * i / thread_count),
+            (int)((long long)count * (i + 1) / thread_count)
+        };
+    }
+
+    for (int i = 1; i < thread_count; ++i)
+    {
+        started[i] = start_worker(&threads[i], &bands[i]);
+
+        if (!started[i])
+            LOG_WARN("could not start worker %d, running its band on the calling thread", i);
+    }
+    run_band(&bands[0]);
+
+    for (int i = 1; i < thread_count; ++i)
+    {
+        if (started[i])
+            join_worker(threads[i]);
+
+        else
+            run_band(&bands[i]);
+    }
+    free(started);
+    free(threads);
+    free(bands);
+}
+
+// Every worker owns a contiguous slice of the task order, packed as [first, end) into one word so it can be claimed with a single compare and swap.
+// The owner takes tasks from the front, thieves take them from the back.
+#ifdef _WIN32
+typedef volatile LONG64 task_queue;
+
+long long load_queue(task_queue* queue)
+{
+    return InterlockedCompareExchange64(queue, 0, 0);
+}
+
+int swap_queue(task_queue* queue, long long expected, long long desired)
+{
+    return InterlockedCompareExchange64(queue, desired, expected) == expected;
+}
+
+#else
+typedef volatile long long task_queue;
+
+long long load_queue(task_queue* queue)
+{
+    return __atomic_load_n(queue, __ATOMIC_ACQUIRE);
+}
+
+int swap_queue(task_queue* queue, long long expected, long long desired)
+{
+    return __atomic_compare_exchange_n(queue, &expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+#endif
+
+long long pack_queue(int first, int end)
+{
+    return (long long)(((unsigned long long)(unsigned int)end << 32) | (unsigned int)first);
+}
+
+typedef struct
+{
+    task_job job;
+    void* userdata;
+    int* order;
+    task_queue* queues;
+    int worker_count;
+} task_pool;
+
+typedef struct
+{
+    int size;
+    int task;
+} sized_task;
+
+int compare_sized_tasks(const void* a, const void* b)
+{
+    const sized_task* left = a;
+    const sized_task* right = b;
+
+    if (left->size != right->size)
+        return left->size > right->size ? -1 : 1;
+
+    return (left->task > right->task) - (left->task < right->task);
+}
+
+// Gives back the next task of the queue or -1 when it is empty
+int claim_task(task_pool* pool, int worker, int from_back)
+{
+    task_queue* queue = &pool->queues[worker];
+
+    while (1)
+    {
+        long long current = load_queue(queue);
+        int first = (int)(unsigned int)(current & 0xffffffff);
+        int end = (int)(unsigned int)((unsigned long long)current >> 32);
+
+        if (first >= end)
+            return -1;
+
+        long long claimed = from_back ? pack_queue(first, end - 1) : pack_queue(first + 1, end);
+
+        if (swap_queue(queue, current, claimed))
+            return pool->order[from_back ? end - 1 : first];
+    }
+}
+
+int steal_task(task_pool* pool, int worker)
+{
+    for (int i = 1; i < pool->worker_count; ++i)
+    {
+        int task = claim_task(pool, (worker + i) % pool->worker_count, 1);
+
+        if (task >= 0)
+            return task;
+    }
+    return -1;
+}
+
+// Every band is a single worker, no tasks are ever added so the pool is done once nothing is left to steal
+void work_on_tasks(void* userdata, int band_start, int band_end)
+{
+    (void)band_end; //always band_start + 1
+    task_pool* pool = userdata;
+    int worker = band_start;
+
+    while (1)
+    {
+        int task = claim_task(pool, worker, 0);
+
+        if (task < 0)
+            task = steal_task(pool, worker);
+
+        if (task < 0)
+            return;
+
+        pool->job(pool->userdata, task, worker);
+    }
+}
+
+void run_tasks(int thread_count, int task_count, const int* task_sizes, task_job job, void* userdata)
+{
+    if (task_count < 1)
+        return;
+
+    if (thread_count > task_count)
+        thread_count = task_count;
+
+    if (thread_count < 1)
+        thread_count = 1;
+
+    sized_task* sized = calloc(task_count, sizeof(sized_task));
+
+    for (int i = 0; i < task_count; ++i)
+    {
+        sized[i] = (sized_task){ task_sizes ? task_sizes[i] : 0, i };
+    }
+
+    if (task_sizes)
+        qsort(sized, task_count, sizeof(sized_task), compare_sized_tasks);
+
+    //deal the tasks out like cards so every worker starts on one of the biggest
+    task_pool pool = {
+        job, userdata,
+        calloc(task_count, sizeof(int)),
+        calloc(thread_count, sizeof(task_queue)),
+        thread_count
+    };
+    int next = 0;
+
+    for (int worker = 0; worker < thread_count; ++worker)
+    {
+        int first = next;
+
+        for (int i = worker; i < task_count; i += thread_count)
+        {
+            pool.order[next++] = sized[i].task;
+        }
+        pool.queues[worker] = pack_queue(first, next);
+    }
+    free(sized);
+
+    run_in_bands(thread_count, thread_count, work_on_tasks, &pool);
+
+    free((void*)pool.queues);
+    free(pool.order);
+}
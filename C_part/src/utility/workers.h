@@ -0,0 +1,18 @@
+#pragma once
+
+// Work on the rows [band_start, band_end) of whatever userdata describes
+typedef void (*band_job)(void* userdata, int band_start, int band_end);
+
+// Work on one task out of whatever userdata describes, worker is the index of the thread running it
+typedef void (*task_job)(void* userdata, int task, int worker);
+
+int get_core_count();
+
+// Splits [0, count) into one contiguous band per thread and runs job on every band in parallel.
+// The calling thread works on the first band itself and returns once every band is done.
+void run_in_bands(int thread_count, int count, band_job job, void* userdata);
+
+// Runs job once for every task in [0, task_count) on a pool of thread_count workers that steal from each other once their own queue runs dry.
+// When task_sizes is given the biggest tasks are handed out first so they dont end up as stragglers.
+// Tasks run in no particular order, so jobs should write their results into a slot of their own.
+void run_tasks(int thread_count, int task_count, const int* task_sizes, task_job job, void* userdata);
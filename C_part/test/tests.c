@@ -14,12 +14,21 @@
 #include "debug.h"
 #include "../src/chunkmap.h"
 #include "../src/imagefile/pngfile.h"
+#include "../src/imagefile/jpegfile.h"
+#include "../src/imagefile/loader.h"
 #include "../src/imagefile/bmp.h"
 #include "../src/entrypoint.h"
 #include "../src/nsvg/usage.h"
 #include "tears.h"
 #include "../src/utility/error.h"
+#include "../src/utility/workers.h"
+#include "../src/utility/arena.h"
 #include "../src/imagefile/svg.h"
+#include "../src/nsvg/bobsweep.h"
+#include "../src/nsvg/bands.h"
+#include "../src/kernels.h"
+#include "../src/simplify.h"
+#include "../src/palette.h"
 
 MunitResult aTestCanPass(const MunitParameter params[], void* data) {
   DEBUG_OUT("test 1 passed");
@@ -63,7 +72,7 @@ MunitResult opensPngAndOutputsBmp(const MunitParameter params[], void* userdata)
 
   stuff->img = convert_png_to_image(in_file);
 
-  munit_assert_ptr_not_null(stuff->img.pixels_array_2d); // FAILED TO CONVERT IMAGE
+  munit_assert_ptr_not_null(stuff->img.pixels); // FAILED TO CONVERT IMAGE
 
   write_image_to_bmp(stuff->img, out_file);
 
@@ -118,15 +127,15 @@ MunitResult can_write_chunkmap_shapes_to_file(const MunitParameter params[], voi
   };
 
   stuff->img = convert_png_to_image(fileaddress);
-  DEBUG_OUT("asserting pixels_array_2d not null");
-  munit_assert_ptr_not_null(stuff->img.pixels_array_2d);
+  DEBUG_OUT("asserting pixels not null");
+  munit_assert_ptr_not_null(stuff->img.pixels);
   DEBUG_OUT("generating chunkmap");
   chunkmap* map = generate_chunkmap(stuff->img, options);
   munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
   stuff->map = map;
 
-  DEBUG_OUT("asserting groups_array_2d not null");
-  munit_assert_ptr_not_null(map->groups_array_2d);
+  DEBUG_OUT("asserting chunks not null");
+  munit_assert_ptr_not_null(map->chunks);
   DEBUG_OUT("filling chunkmap");
   fill_chunkmap(stuff->map, &options);
   munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
@@ -165,8 +174,8 @@ MunitResult can_write_to_svgfile(const MunitParameter params[], void* userdata)
   };
 
   stuff->img = convert_png_to_image(fileaddress);
-  DEBUG_OUT("asserting pixels_array_2d not null");
-  munit_assert_ptr_not_null(stuff->img.pixels_array_2d);
+  DEBUG_OUT("asserting pixels not null");
+  munit_assert_ptr_not_null(stuff->img.pixels);
   munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
 
   stuff->nsvg_image = dcdfill_for_nsvg(stuff->img, options);
@@ -214,7 +223,7 @@ MunitResult can_do_speedy_vectorize(const MunitParameter params[], void* userdat
   };
 
   stuff->img = convert_png_to_image(fileaddress);
-  munit_assert_ptr_not_null(stuff->img.pixels_array_2d);
+  munit_assert_ptr_not_null(stuff->img.pixels);
   munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
 
   stuff->nsvg_image = bobsweep_for_nsvg(stuff->img, options);
@@ -232,6 +241,886 @@ MunitResult can_do_speedy_vectorize(const MunitParameter params[], void* userdat
   return MUNIT_OK;
 }
 
+MunitResult summed_area_table_matches_direct_average(const MunitParameter params[], void* userdata) {
+  image img = convert_png_to_image(params[0].value);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+
+  summed_area_table* table = create_summed_area_table(img);
+  munit_assert_ptr_not_null(table);
+  int chunk_sizes[] = { 1, 3, 7, 16 };
+
+  for (int i = 0; i < 4; ++i) {
+    vectorize_options options = {
+      params[0].value,
+      chunk_sizes[i],
+      atof(params[2].value),
+      atoi(params[4].value)
+    };
+    chunkmap* direct = generate_chunkmap(img, options);
+    chunkmap* from_table = generate_chunkmap_from_table(img, table, options);
+    munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+    munit_assert_int(direct->map_width, ==, from_table->map_width);
+    munit_assert_int(direct->map_height, ==, from_table->map_height);
+
+    for (int x = 0; x < direct->map_width; ++x) {
+      for (int y = 0; y < direct->map_height; ++y) {
+        pixel a = get_chunk(direct, x, y)->average_colour;
+        pixel b = get_chunk(from_table, x, y)->average_colour;
+        munit_assert_int(a.r, ==, b.r);
+        munit_assert_int(a.g, ==, b.g);
+        munit_assert_int(a.b, ==, b.b);
+      }
+    }
+    free_chunkmap(direct);
+    free_chunkmap(from_table);
+  }
+  free_summed_area_table(table);
+  free_image_contents(img);
+  return MUNIT_OK;
+}
+
+MunitResult threaded_chunkmap_matches_single_thread(const MunitParameter params[], void* userdata) {
+  image img = convert_png_to_image(params[0].value);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+
+  vectorize_options options = {
+    params[0].value,
+    atoi(params[1].value),
+    atof(params[2].value),
+    atoi(params[4].value),
+    1
+  };
+  chunkmap* single = generate_chunkmap(img, options);
+  options.thread_count = 7;
+  chunkmap* threaded = generate_chunkmap(img, options);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+
+  for (int x = 0; x < single->map_width; ++x) {
+    for (int y = 0; y < single->map_height; ++y) {
+      munit_assert_memory_equal(sizeof(pixelchunk), get_chunk(single, x, y), get_chunk(threaded, x, y));
+    }
+  }
+  free_chunkmap(single);
+  free_chunkmap(threaded);
+  free_image_contents(img);
+  return MUNIT_OK;
+}
+
+void count_task_runs(void* userdata, int task, int worker) {
+  int* runs = userdata;
+  ++runs[task];
+}
+
+MunitResult sweep_labels_join_every_similar_neighbour(const MunitParameter params[], void* userdata) {
+  image img = convert_png_to_image(params[0].value);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+
+  vectorize_options options = {
+    params[0].value,
+    atoi(params[1].value),
+    atof(params[2].value),
+    atoi(params[4].value)
+  };
+  chunkmap* single = generate_chunkmap(img, options);
+  chunkmap* threaded = generate_chunkmap(img, options);
+  sweepfill_chunkmap(single, options.shape_colour_threshhold, 1);
+  sweepfill_chunkmap(threaded, options.shape_colour_threshhold, 5);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  munit_assert_int(single->shape_count, ==, threaded->shape_count);
+
+  for (int y = 0; y < threaded->map_height; ++y) {
+    for (int x = 0; x < threaded->map_width; ++x) {
+      pixelchunk* chunk = get_chunk(threaded, x, y);
+      munit_assert_int(chunk->shape_index, ==, get_chunk(single, x, y)->shape_index);
+
+      for (int k = 0; k < NEIGHBOUR_COUNT; ++k) {
+        pixelchunk* adjacent = get_chunk(threaded, x + NEIGHBOUR_X[k], y + NEIGHBOUR_Y[k]);
+
+        if (!(adjacent->flags & CHUNK_GHOST) && colours_are_similar(chunk->average_colour, adjacent->average_colour, options.shape_colour_threshhold))
+          munit_assert_int(chunk->shape_index, ==, adjacent->shape_index);
+      }
+    }
+  }
+  free_chunkmap(single);
+  free_chunkmap(threaded);
+  free_image_contents(img);
+  return MUNIT_OK;
+}
+
+MunitResult sweep_borders_follow_shapes(const MunitParameter params[], void* userdata) {
+  enum { SIZE = 5 };
+  uint8_t rgb[SIZE * SIZE * 3] = { 0 };
+
+  for (int i = 0; i < SIZE * SIZE; ++i)
+    rgb[i * 3] = 20;
+
+  //the chunk at (1, 2) isn't similar to the ones right of it, but joins them through (1, 1), so it is all one shape
+  rgb[(1 + 1 * SIZE) * 3] = 10;
+  rgb[(1 + 2 * SIZE) * 3] = 0;
+
+  vectorize_options options = { NULL, 1, 12.f, 256 };
+  chunkmap* map = generate_chunkmap_from_pixels(rgb, SIZE, SIZE, SIZE * 3, 3, options);
+  sweepfill_chunkmap(map, options.shape_colour_threshhold, 1);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  munit_assert_int(map->shape_count, ==, 1);
+
+  //only the edge of the image borders another shape
+  chunkshape* shape = &map->shape_list[0];
+  munit_assert_int(shape->boundaries_length, ==, SIZE * 4 - 4);
+
+  for (int i = 0; i < shape->boundaries_length; ++i) {
+    int32_t index = map->boundary_indices[shape->boundaries_offset + i];
+    int x = index % SIZE, y = index / SIZE;
+    munit_assert_true(x == 0 || y == 0 || x == SIZE - 1 || y == SIZE - 1);
+  }
+  free_chunkmap(map);
+  return MUNIT_OK;
+}
+
+MunitResult similar_neighbours_match_colour_distance(const MunitParameter params[], void* userdata) {
+  image img = convert_png_to_image(params[0].value);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+
+  vectorize_options options = {
+    params[0].value,
+    atoi(params[1].value),
+    atof(params[2].value),
+    atoi(params[4].value),
+    3
+  };
+  chunkmap* map = generate_chunkmap(img, options);
+  float thresholds[] = { -1.f, 0.f, 1.f, 7.5f, 30.f, 441.7f, 1000.f };
+
+  for (int t = 0; t < sizeof(thresholds) / sizeof(float); ++t) {
+    find_similar_neighbours(map, thresholds[t], options.thread_count);
+    munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+
+    for (int y = 0; y < map->map_height; ++y) {
+      for (int x = 0; x < map->map_width; ++x) {
+        pixelchunk* chunk = get_chunk(map, x, y);
+        byte similar_neighbours = map->similar_neighbours[x + y * map->chunk_stride];
+
+        for (int k = 0; k < NEIGHBOUR_COUNT; ++k) {
+          pixelchunk* adjacent = get_chunk(map, x + NEIGHBOUR_X[k], y + NEIGHBOUR_Y[k]);
+          int expected = !(adjacent->flags & CHUNK_GHOST) && colours_are_similar(chunk->average_colour, adjacent->average_colour, thresholds[t]);
+          munit_assert_int((similar_neighbours >> k) & 1, ==, expected);
+        }
+      }
+    }
+  }
+  free_chunkmap(map);
+  free_image_contents(img);
+  return MUNIT_OK;
+}
+
+MunitResult kernels_match_scalar(const MunitParameter params[], void* userdata) {
+  const pixel_kernels* scalar = get_kernels_of_level(KERNEL_SCALAR);
+  munit_assert_ptr_not_null(scalar);
+  munit_assert_ptr_not_null(get_pixel_kernels());
+
+  enum { LENGTH = 203 };
+  pixel pixels[LENGTH];
+  pixelchunk row[LENGTH], adjacent[LENGTH];
+
+  for (int i = 0; i < LENGTH; ++i) {
+    pixels[i] = (pixel){ munit_rand_int_range(0, 255), munit_rand_int_range(0, 255), munit_rand_int_range(0, 255) };
+    row[i] = (pixelchunk){ pixels[i], munit_rand_int_range(0, 255), i };
+    //mostly close colours so both answers come up
+    adjacent[i] = (pixelchunk){ { pixels[i].r ^ munit_rand_int_range(0, 15), pixels[i].g, pixels[i].b ^ munit_rand_int_range(0, 7) }, munit_rand_int_range(0, 255), -i };
+  }
+
+  similarity_matrix matrix;
+  byte row_indices[LENGTH], adjacent_indices[LENGTH];
+  munit_rand_memory(sizeof(matrix), (uint8_t*)&matrix);
+  munit_rand_memory(LENGTH, row_indices);
+  munit_rand_memory(LENGTH, adjacent_indices);
+
+  for (int level = KERNEL_SSE41; level < KERNEL_LEVEL_COUNT; ++level) {
+    const pixel_kernels* kernels = get_kernels_of_level(level);
+
+    if (!kernels)
+      continue;
+
+    for (int count = 0; count <= LENGTH; count += count < 70 ? 1 : 19) {
+      uint32_t expected[3] = { 1, 2, 3 }, actual[3] = { 1, 2, 3 };
+      scalar->sum_pixels(pixels, count, expected);
+      kernels->sum_pixels(pixels, count, actual);
+      munit_assert_memory_equal(sizeof(expected), expected, actual);
+
+      byte expected_masks[LENGTH], actual_masks[LENGTH];
+      int limit = count * 3 - 10;
+      memset(expected_masks, 0x41, sizeof(expected_masks));
+      memset(actual_masks, 0x41, sizeof(actual_masks));
+      scalar->mark_similar_chunks(row, adjacent, count, limit, 0x10, expected_masks);
+      kernels->mark_similar_chunks(row, adjacent, count, limit, 0x10, actual_masks);
+      munit_assert_memory_equal(LENGTH, expected_masks, actual_masks);
+
+      scalar->mark_similar_indices(row_indices, adjacent_indices, count, &matrix, 0x04, expected_masks);
+      kernels->mark_similar_indices(row_indices, adjacent_indices, count, &matrix, 0x04, actual_masks);
+      munit_assert_memory_equal(LENGTH, expected_masks, actual_masks);
+    }
+
+    for (int num_colours = 1; num_colours <= 256; ++num_colours) {
+      quantize_table table = create_quantize_table(num_colours);
+      byte expected[LENGTH * 3], actual[LENGTH * 3];
+      memcpy(expected, pixels, sizeof(expected));
+      memcpy(actual, pixels, sizeof(actual));
+      int count = LENGTH * 3 - num_colours % 64;
+      scalar->quantize_bytes(expected, count, &table);
+      kernels->quantize_bytes(actual, count, &table);
+      munit_assert_memory_equal(sizeof(expected), expected, actual);
+
+      for (int value = 0; value < 256; ++value)
+        munit_assert_int(table.values[value], ==, quantize_int(value, table.divisions));
+    }
+  }
+  return MUNIT_OK;
+}
+
+MunitResult palette_quantizer_limits_colours(const MunitParameter params[], void* userdata) {
+  image img = convert_png_to_image(params[0].value);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+
+  palette* single = create_palette(img, 16, 4, 1);
+  palette* threaded = create_palette(img, 16, 4, 5);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  munit_assert_int(single->count, <=, 16);
+  munit_assert_memory_equal(sizeof(palette), single, threaded);
+
+  indexed_image indexed = create_indexed_image(img, threaded, 3);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+
+  for (int y = 0; y < indexed.height; ++y) {
+    for (int x = 0; x < indexed.width; ++x) {
+      byte index = indexed.indices[(size_t)y * indexed.stride + x];
+      munit_assert_int(index, <, threaded->count);
+      munit_assert_int(index, ==, threaded->lookup[get_palette_cell(get_image_row(img, y)[x])]);
+    }
+  }
+  free_indexed_image(indexed);
+
+  vectorize_options options = { params[0].value, 1, 1, 16, 3, QUANTIZE_PALETTE, 4 };
+  quantize_image(&img, options);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+
+  for (int y = 0; y < img.height; ++y) {
+    for (int x = 0; x < img.width; ++x) {
+      pixel colour = get_image_row(img, y)[x];
+      int found = 0;
+
+      for (int i = 0; i < single->count; ++i)
+        found |= memcmp(&colour, &single->colours[i], sizeof(pixel)) == 0;
+
+      munit_assert_true(found);
+    }
+  }
+  free_palette(single);
+  free_palette(threaded);
+  free_image_contents(img);
+  return MUNIT_OK;
+}
+
+MunitResult palette_indices_match_colour_similarity(const MunitParameter params[], void* userdata) {
+  image img = convert_png_to_image(params[0].value);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+
+  vectorize_options options = { params[0].value, 1, 1, 24, 3, QUANTIZE_PALETTE, 2 };
+  indexed_image indexed = quantize_image_keeping_indices(&img, options);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  munit_assert_not_null(indexed.indices);
+
+  chunkmap* by_colour = generate_chunkmap(img, options);
+  chunkmap* by_index = generate_chunkmap(img, options);
+  set_chunk_palette(by_index, indexed);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  free_indexed_image(indexed);
+  free_palette(indexed.palette);
+
+  float thresholds[] = { -1.f, 0.f, 7.5f, 30.f, 90.f, 1000.f };
+  size_t grid_size = (size_t)by_colour->chunk_stride * (by_colour->map_height + 2);
+
+  for (int t = 0; t < sizeof(thresholds) / sizeof(float); ++t) {
+    find_similar_neighbours(by_colour, thresholds[t], options.thread_count);
+    find_similar_neighbours(by_index, thresholds[t], options.thread_count);
+    munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+    munit_assert_memory_equal(grid_size,
+      by_colour->similar_neighbours - by_colour->chunk_stride - 1,
+      by_index->similar_neighbours - by_index->chunk_stride - 1);
+  }
+  free_chunkmap(by_colour);
+  free_chunkmap(by_index);
+  free_image_contents(img);
+  return MUNIT_OK;
+}
+
+MunitResult quantizing_chunks_leaves_image_alone(const MunitParameter params[], void* userdata) {
+  image img = convert_png_to_image(params[0].value);
+  image quantized = convert_png_to_image(params[0].value);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  size_t image_size = (size_t)img.stride * img.height * sizeof(pixel);
+  pixel* original = malloc(image_size);
+  memcpy(original, img.pixels, image_size);
+
+  // one pixel per chunk, quantizing the chunks is the same as quantizing the image first
+  vectorize_options fused = { params[0].value, 1, 1, 16, 3, QUANTIZE_CHANNELS, 0, true };
+  vectorize_options separate = { params[0].value, 1, 1, 16, 3, QUANTIZE_CHANNELS, 0, false };
+  chunkmap* fused_map = generate_chunkmap(img, fused);
+  quantize_image(&quantized, separate);
+  chunkmap* separate_map = generate_chunkmap(quantized, separate);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  munit_assert_memory_equal(image_size, original, img.pixels);
+
+  for (int y = 0; y < fused_map->map_height; ++y) {
+    for (int x = 0; x < fused_map->map_width; ++x) {
+      munit_assert_memory_equal(sizeof(pixel), &get_chunk(fused_map, x, y)->average_colour, &get_chunk(separate_map, x, y)->average_colour);
+    }
+  }
+  free_chunkmap(fused_map);
+  free_chunkmap(separate_map);
+
+  // bigger chunks get their averages swapped for palette colours, and keep the indices
+  vectorize_options palette_chunks = { params[0].value, 3, 1, 16, 3, QUANTIZE_PALETTE, 2, true };
+  chunkmap* map = generate_chunkmap(img, palette_chunks);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  munit_assert_memory_equal(image_size, original, img.pixels);
+  munit_assert_not_null(map->palette);
+
+  for (int y = 0; y < map->map_height; ++y) {
+    for (int x = 0; x < map->map_width; ++x) {
+      byte index = map->colour_indices[x + y * map->chunk_stride];
+      munit_assert_int(index, <, map->palette->count);
+      munit_assert_memory_equal(sizeof(pixel), &get_chunk(map, x, y)->average_colour, &map->palette->colours[index]);
+    }
+  }
+  free_chunkmap(map);
+  free(original);
+  free_image_contents(img);
+  free_image_contents(quantized);
+  return MUNIT_OK;
+}
+
+MunitResult decoding_to_chunks_matches_quantized_chunkmap(const MunitParameter params[], void* userdata) {
+  image img = convert_png_to_image(params[0].value);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  int chunk_sizes[] = { 1, 3, 16, 37 };
+
+  for (int i = 0; i < sizeof(chunk_sizes) / sizeof(int); ++i) {
+    vectorize_options options = { params[0].value, chunk_sizes[i], 1, 16, 3, QUANTIZE_CHANNELS, 0, true, true };
+    chunkmap* decoded = convert_png_to_chunkmap(params[0].value, options);
+    chunkmap* averaged = generate_chunkmap(img, options);
+    munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+    munit_assert_null(decoded->input.pixels);
+    munit_assert_int(decoded->input.width, ==, img.width);
+    munit_assert_int(decoded->input.height, ==, img.height);
+    munit_assert_int(decoded->map_width, ==, averaged->map_width);
+    munit_assert_int(decoded->map_height, ==, averaged->map_height);
+
+    size_t grid_size = (size_t)decoded->chunk_stride * (decoded->map_height + 2) * sizeof(pixelchunk);
+    munit_assert_memory_equal(grid_size, decoded->chunks - decoded->chunk_stride - 1, averaged->chunks - averaged->chunk_stride - 1);
+    free_chunkmap(decoded);
+    free_chunkmap(averaged);
+  }
+  free_image_contents(img);
+  return MUNIT_OK;
+}
+
+MunitResult buffers_match_files(const MunitParameter params[], void* userdata) {
+  image img = convert_png_to_image(params[0].value);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+
+  FILE* file = fopen(params[0].value, "rb");
+  munit_assert_not_null(file);
+  fseek(file, 0, SEEK_END);
+  size_t length = (size_t)ftell(file);
+  fseek(file, 0, SEEK_SET);
+  uint8_t* data = malloc(length);
+  munit_assert_size(fread(data, 1, length, file), ==, length);
+  fclose(file);
+
+  image from_buffer = convert_png_buffer_to_image(data, length);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  munit_assert_int(from_buffer.width, ==, img.width);
+  munit_assert_int(from_buffer.height, ==, img.height);
+
+  for (int y = 0; y < img.height; ++y)
+    munit_assert_memory_equal(img.width * sizeof(pixel), get_image_row(img, y), get_image_row(from_buffer, y));
+
+  image truncated = convert_png_buffer_to_image(data, length / 2);
+  munit_assert_int(getAndResetErrorCode(), ==, READ_FILE_ERROR);
+  munit_assert_null(truncated.pixels);
+
+  // the same pixels handed over as padded rgb and rgba rows
+  vectorize_options options = { NULL, 3, 1, 16, 3, QUANTIZE_CHANNELS, 0, true };
+  chunkmap* expected = generate_chunkmap(img, options);
+  size_t rgb_stride = (size_t)img.width * 3 + 5;
+  size_t rgba_stride = (size_t)img.width * 4;
+  uint8_t* rgb = calloc(rgb_stride * img.height, 1);
+  uint8_t* rgba = calloc(rgba_stride * img.height, 1);
+
+  for (int y = 0; y < img.height; ++y) {
+    memcpy(&rgb[y * rgb_stride], get_image_row(img, y), (size_t)img.width * 3);
+
+    for (int x = 0; x < img.width; ++x) {
+      pixel colour = get_image_row(img, y)[x];
+      uint8_t* rgba_pixel = &rgba[y * rgba_stride + x * 4];
+      rgba_pixel[0] = colour.r;
+      rgba_pixel[1] = colour.g;
+      rgba_pixel[2] = colour.b;
+      rgba_pixel[3] = (uint8_t)(x + y);
+    }
+  }
+  chunkmap* from_rgb = generate_chunkmap_from_pixels(rgb, img.width, img.height, rgb_stride, 3, options);
+  chunkmap* from_rgba = generate_chunkmap_from_pixels(rgba, img.width, img.height, rgba_stride, 4, options);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+
+  size_t grid_size = (size_t)expected->chunk_stride * (expected->map_height + 2) * sizeof(pixelchunk);
+  munit_assert_memory_equal(grid_size, expected->chunks - expected->chunk_stride - 1, from_rgb->chunks - from_rgb->chunk_stride - 1);
+  munit_assert_memory_equal(grid_size, expected->chunks - expected->chunk_stride - 1, from_rgba->chunks - from_rgba->chunk_stride - 1);
+
+  munit_assert_null(generate_chunkmap_from_pixels(rgb, img.width, img.height, rgb_stride, 2, options));
+  munit_assert_int(getAndResetErrorCode(), ==, BAD_ARGUMENT_ERROR);
+
+  free_chunkmap(expected);
+  free_chunkmap(from_rgb);
+  free_chunkmap(from_rgba);
+  free(rgb);
+  free(rgba);
+  free(data);
+  free_image_contents(from_buffer);
+  free_image_contents(img);
+  return MUNIT_OK;
+}
+
+MunitResult png_stream_matches_file(const MunitParameter params[], void* userdata) {
+  FILE* file = fopen(params[0].value, "rb");
+  munit_assert_not_null(file);
+  fseek(file, 0, SEEK_END);
+  size_t length = (size_t)ftell(file);
+  fseek(file, 0, SEEK_SET);
+  uint8_t* data = malloc(length);
+  munit_assert_size(fread(data, 1, length, file), ==, length);
+  fclose(file);
+
+  vectorize_options options = { params[0].value, 3, 1, 16, 3, QUANTIZE_CHANNELS, 0, true, true };
+  chunkmap* expected = convert_png_to_chunkmap(params[0].value, options);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+
+  // pieces of every size from a single byte up, like a download would hand them over
+  png_stream* stream = create_png_stream(options);
+  size_t piece = 1;
+
+  for (size_t offset = 0; offset < length; offset += piece, piece = piece * 3 % 4093 + 1) {
+    size_t size = length - offset < piece ? length - offset : piece;
+    push_png_bytes(stream, data + offset, size);
+    munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  }
+  chunkmap* streamed = finish_png_stream(stream);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+
+  size_t grid_size = (size_t)expected->chunk_stride * (expected->map_height + 2) * sizeof(pixelchunk);
+  munit_assert_int(streamed->map_width, ==, expected->map_width);
+  munit_assert_int(streamed->map_height, ==, expected->map_height);
+  munit_assert_memory_equal(grid_size, expected->chunks - expected->chunk_stride - 1, streamed->chunks - streamed->chunk_stride - 1);
+
+  // a download that stops halfway gives no chunkmap
+  stream = create_png_stream(options);
+  push_png_bytes(stream, data, length / 2);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  munit_assert_null(finish_png_stream(stream));
+  munit_assert_int(getAndResetErrorCode(), ==, READ_FILE_ERROR);
+
+  free_chunkmap(expected);
+  free_chunkmap(streamed);
+  free(data);
+  return MUNIT_OK;
+}
+
+MunitResult jpeg_scaled_decoding_matches_chunks(const MunitParameter params[], void* userdata) {
+  int full_scale = 1;
+  image full = convert_jpeg_to_image(params[0].value, &full_scale);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  munit_assert_int(full_scale, ==, 1);
+
+  // every pixel of the scaled decode is close to the average of its block
+  int scale = 8;
+  image scaled = convert_jpeg_to_image(params[0].value, &scale);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  munit_assert_int(scale, ==, 8);
+  munit_assert_int(scaled.width, ==, (full.width + 7) / 8);
+  munit_assert_int(scaled.height, ==, (full.height + 7) / 8);
+  double difference = 0;
+
+  for (int y = 0; y < scaled.height; ++y) {
+    for (int x = 0; x < scaled.width; ++x) {
+      int sums[3] = { 0 };
+      int count = 0;
+
+      for (int py = y * 8; py < y * 8 + 8 && py < full.height; ++py) {
+        for (int px = x * 8; px < x * 8 + 8 && px < full.width; ++px, ++count) {
+          pixel current = get_image_row(full, py)[px];
+          sums[0] += current.r;
+          sums[1] += current.g;
+          sums[2] += current.b;
+        }
+      }
+      pixel decoded = get_image_row(scaled, y)[x];
+      difference += abs(sums[0] / count - decoded.r) + abs(sums[1] / count - decoded.g) + abs(sums[2] / count - decoded.b);
+    }
+  }
+  munit_assert_double(difference / (scaled.width * scaled.height * 3), <, 2.0);
+
+  // the decoder does the 8x8 blocks of the chunk size, the accumulator the rest
+  vectorize_options options = { params[0].value, 24, 1, 16, 3, QUANTIZE_CHANNELS, 0, true, true };
+  chunkmap* decoded = convert_jpeg_to_chunkmap(params[0].value, options);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  options.chunk_size = 3;
+  chunkmap* expected = generate_chunkmap(scaled, options);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+
+  size_t grid_size = (size_t)expected->chunk_stride * (expected->map_height + 2) * sizeof(pixelchunk);
+  munit_assert_int(decoded->map_width, ==, (full.width + 23) / 24);
+  munit_assert_int(decoded->map_height, ==, (full.height + 23) / 24);
+  munit_assert_int(decoded->map_width, ==, expected->map_width);
+  munit_assert_memory_equal(grid_size, expected->chunks - expected->chunk_stride - 1, decoded->chunks - decoded->chunk_stride - 1);
+
+  // chunks that don't divide by 8 are averaged from every pixel
+  options.chunk_size = 12;
+  chunkmap* unscaled = convert_jpeg_to_chunkmap(params[0].value, options);
+  chunkmap* unscaled_expected = generate_chunkmap(full, options);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  grid_size = (size_t)unscaled_expected->chunk_stride * (unscaled_expected->map_height + 2) * sizeof(pixelchunk);
+  munit_assert_int(unscaled->map_width, ==, (full.width + 11) / 12);
+  munit_assert_memory_equal(grid_size, unscaled_expected->chunks - unscaled_expected->chunk_stride - 1, unscaled->chunks - unscaled->chunk_stride - 1);
+
+  // the loader tells the formats apart, and only a jpeg takes over part of the chunking
+  vectorize_options jpeg_options = { params[0].value, 8, 1, 16, 3, QUANTIZE_CHANNELS, 0, false, false };
+  image loaded = load_image_file(&jpeg_options);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  munit_assert_int(jpeg_options.chunk_size, ==, 1);
+  munit_assert_int(loaded.width, ==, (full.width + 7) / 8);
+
+  vectorize_options png_options = { "../../../../test/test2.png", 8, 1, 16, 3, QUANTIZE_CHANNELS, 0, false, false };
+  image png = load_image_file(&png_options);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  munit_assert_int(png_options.chunk_size, ==, 8);
+  munit_assert_int(png.width, ==, full.width);
+
+  scale = 1;
+  munit_assert_null(convert_jpeg_to_image("../../../../test/test2.png", &scale).pixels);
+  munit_assert_int(getAndResetErrorCode(), ==, NOT_JPEG);
+
+  free_chunkmap(decoded);
+  free_chunkmap(expected);
+  free_chunkmap(unscaled);
+  free_chunkmap(unscaled_expected);
+  free_image_contents(full);
+  free_image_contents(scaled);
+  free_image_contents(loaded);
+  free_image_contents(png);
+  return MUNIT_OK;
+}
+
+MunitResult png_formats_decode_to_rgb(const MunitParameter params[], void* userdata) {
+  enum { WIDTH = 50, HEIGHT = 31, COLOURS = 12 };
+  byte colourmap[COLOURS * 3];
+  byte indices[WIDTH * HEIGHT];
+  byte greys[WIDTH * HEIGHT];
+
+  for (int i = 0; i < COLOURS * 3; ++i)
+    colourmap[i] = (byte)(i * 71 % 256);
+
+  for (int i = 0; i < WIDTH * HEIGHT; ++i) {
+    indices[i] = (byte)((i % WIDTH / 4 + i / WIDTH / 3 * 5) % COLOURS);
+    greys[i] = (byte)(i * 13 % 256);
+  }
+
+  // 12 colours get written with 4 bit indices, and the greys as 8 bit greyscale
+  png_image palette_png = { NULL, PNG_IMAGE_VERSION, WIDTH, HEIGHT, PNG_FORMAT_RGB_COLORMAP, 0, COLOURS };
+  munit_assert_true(png_image_write_to_file(&palette_png, "./palette.png", 0, indices, 0, colourmap));
+  png_image grey_png = { NULL, PNG_IMAGE_VERSION, WIDTH, HEIGHT, PNG_FORMAT_GRAY };
+  munit_assert_true(png_image_write_to_file(&grey_png, "./grey.png", 0, greys, 0, NULL));
+
+  image greyscale = convert_png_to_image("./grey.png");
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  image expanded = convert_png_to_image("./palette.png");
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+
+  for (int y = 0; y < HEIGHT; ++y) {
+    for (int x = 0; x < WIDTH; ++x) {
+      pixel shade = get_image_row(greyscale, y)[x];
+      pixel colour = get_image_row(expanded, y)[x];
+      byte* entry = &colourmap[indices[x + y * WIDTH] * 3];
+      munit_assert_true(shade.r == greys[x + y * WIDTH] && shade.g == shade.r && shade.b == shade.r);
+      munit_assert_true(colour.r == entry[0] && colour.g == entry[1] && colour.b == entry[2]);
+    }
+  }
+
+  // the palette fits in 16 colours, so the chunks keep it and every index instead of being quantized
+  vectorize_options options = { "./palette.png", 1, 1, 16, 3, QUANTIZE_CHANNELS, 0, true, true };
+  munit_assert_true(png_file_keeps_palette("./palette.png", options));
+  chunkmap* indexed = convert_png_to_chunkmap("./palette.png", options);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  munit_assert_not_null(indexed->palette);
+  munit_assert_int(indexed->palette->count, ==, COLOURS);
+
+  for (int y = 0; y < HEIGHT; ++y) {
+    for (int x = 0; x < WIDTH; ++x) {
+      munit_assert_int(indexed->colour_indices[x + y * indexed->chunk_stride], ==, indices[x + y * WIDTH]);
+      munit_assert_memory_equal(sizeof(pixel), &get_chunk(indexed, x, y)->average_colour, &get_image_row(expanded, y)[x]);
+    }
+  }
+
+  // a png in memory makes the same choice as the file, the palette goes to chunks even when decoding whole
+  vectorize_options whole_options = { "./palette.png", 1, 1, 16, 3, QUANTIZE_CHANNELS, 0, false, false };
+  FILE* file = fopen("./palette.png", "rb");
+  munit_assert_not_null(file);
+  fseek(file, 0, SEEK_END);
+  size_t length = (size_t)ftell(file);
+  fseek(file, 0, SEEK_SET);
+  uint8_t* data = malloc(length);
+  munit_assert_size(fread(data, 1, length, file), ==, length);
+  fclose(file);
+
+  decoded_image_file from_file = decode_image_file(&whole_options);
+  decoded_image_file from_buffer = decode_image_buffer(data, length, &whole_options);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  munit_assert_not_null(from_file.map);
+  munit_assert_not_null(from_buffer.map);
+  munit_assert_null(from_buffer.img.pixels);
+  munit_assert_not_null(from_buffer.map->palette);
+  size_t grid_size = (size_t)from_file.map->chunk_stride * (from_file.map->map_height + 2) * sizeof(pixelchunk);
+  munit_assert_memory_equal(grid_size, from_file.map->chunks - from_file.map->chunk_stride - 1, from_buffer.map->chunks - from_buffer.map->chunk_stride - 1);
+  free_chunkmap(from_file.map);
+  free_chunkmap(from_buffer.map);
+  free(data);
+
+  // bigger chunks are snapped to the palette
+  options.chunk_size = 3;
+  chunkmap* snapped = convert_png_to_chunkmap("./palette.png", options);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+
+  for (int y = 0; y < snapped->map_height; ++y) {
+    for (int x = 0; x < snapped->map_width; ++x) {
+      byte index = snapped->colour_indices[x + y * snapped->chunk_stride];
+      munit_assert_int(index, <, COLOURS);
+      munit_assert_memory_equal(sizeof(pixel), &get_chunk(snapped, x, y)->average_colour, &colourmap[index * 3]);
+    }
+  }
+
+  // and a palette bigger than num_colours gets quantized like any other png
+  options.num_colours = 8;
+  munit_assert_false(png_file_keeps_palette("./palette.png", options));
+  chunkmap* quantized = convert_png_to_chunkmap("./palette.png", options);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  munit_assert_null(quantized->palette);
+
+  free_chunkmap(indexed);
+  free_chunkmap(snapped);
+  free_chunkmap(quantized);
+  free_image_contents(greyscale);
+  free_image_contents(expanded);
+  return MUNIT_OK;
+}
+
+// The whole of a small file, NULL terminated so it can be searched as a string
+char* read_whole_file(const char* path, long* length) {
+  FILE* file = fopen(path, "rb");
+  munit_assert_not_null(file);
+  fseek(file, 0, SEEK_END);
+  *length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  char* contents = calloc(*length + 1, 1);
+  munit_assert_int(fread(contents, 1, *length, file), ==, *length);
+  fclose(file);
+  return contents;
+}
+
+// Checks the svg at OUTPUT_PATH has pieces_per_shape paths in the first fill, then as many in the second
+void assert_banded_fills(const unsigned int fills[2], int pieces_per_shape) {
+  long length;
+  char* svg = read_whole_file(OUTPUT_PATH, &length);
+  int pieces = 0;
+
+  for (char* path = strstr(svg, "<path fill=\"#"); path; path = strstr(path + 1, "<path fill=\"#"), ++pieces) {
+    unsigned int fill;
+    munit_assert_int(sscanf(path + strlen("<path fill=\"#"), "%6X", &fill), ==, 1);
+    munit_assert_int(fill, ==, fills[pieces / pieces_per_shape]);
+  }
+  munit_assert_int(pieces, ==, 2 * pieces_per_shape);
+  free(svg);
+}
+
+MunitResult bands_stitch_shapes_across_seams(const MunitParameter params[], void* userdata) {
+  enum { WIDTH = 24, HEIGHT = 40 };
+  byte pixels[WIDTH * HEIGHT * 3];
+
+  // the left half gets a little redder every row, so each band on its own would start it in a different colour
+  for (int y = 0; y < HEIGHT; ++y) {
+    for (int x = 0; x < WIDTH; ++x) {
+      byte* current = &pixels[(x + y * WIDTH) * 3];
+      bool left = x < WIDTH / 2;
+      current[0] = left ? (byte)(40 + y * 3) : 200;
+      current[1] = left ? 60 : 30;
+      current[2] = left ? 60 : 90;
+    }
+  }
+  png_image gradient_png = { NULL, PNG_IMAGE_VERSION, WIDTH, HEIGHT, PNG_FORMAT_RGB };
+  munit_assert_true(png_image_write_to_file(&gradient_png, "./bands.png", 0, pixels, 0, NULL));
+  vectorize_options options = { "./bands.png", 1, 4, 256, 3, QUANTIZE_CHANNELS, 0, true, true };
+
+  NSVGimage* whole = dcdfill_chunkmap_for_nsvg(load_image_file_to_chunkmap(options), options);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  munit_assert_not_null(whole->shapes);
+  munit_assert_not_null(whole->shapes->next);
+  munit_assert_null(whole->shapes->next->next);
+  unsigned int fills[2] = { whole->shapes->fill.color, whole->shapes->next->fill.color };
+  munit_assert_true(write_svg_file(whole));
+  long whole_length;
+  char* whole_svg = read_whole_file(OUTPUT_PATH, &whole_length);
+
+  // one band holding every chunk writes exactly what the whole map does
+  munit_assert_true(vectorize_file_in_bands(options, dcdfill_find_shapes, (WIDTH + 2) * (HEIGHT + 2)));
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  long one_band_length;
+  char* one_band_svg = read_whole_file(OUTPUT_PATH, &one_band_length);
+  munit_assert_int(one_band_length, ==, whole_length);
+  munit_assert_memory_equal(whole_length, one_band_svg, whole_svg);
+
+  // bands of 4 rows cut both shapes into 10 pieces each, every piece in the colour of its shape and the shapes in order
+  munit_assert_true(vectorize_file_in_bands(options, dcdfill_find_shapes, (WIDTH + 2) * (4 + 2)));
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  assert_banded_fills(fills, HEIGHT / 4);
+
+  // bobsweep finds the same pieces, in the colours its own whole map gives the shapes
+  NSVGimage* swept = bobsweep_chunkmap_for_nsvg(load_image_file_to_chunkmap(options), options);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  munit_assert_not_null(swept->shapes);
+  munit_assert_not_null(swept->shapes->next);
+  munit_assert_null(swept->shapes->next->next);
+  unsigned int swept_fills[2] = { swept->shapes->fill.color, swept->shapes->next->fill.color };
+  free_nsvg(swept);
+
+  munit_assert_true(vectorize_file_in_bands(options, bobsweep_find_shapes, (WIDTH + 2) * (4 + 2)));
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  assert_banded_fills(swept_fills, HEIGHT / 4);
+
+  free(whole_svg);
+  free(one_band_svg);
+  free_nsvg(whole);
+  return MUNIT_OK;
+}
+
+// Copies the outline of the svg's nth path at OUTPUT_PATH, to look for it in another svg
+char* copy_svg_outline(const char* svg, int n) {
+  const char* path = strstr(svg, " d=\"");
+
+  for (int i = 0; i < n && path; ++i)
+    path = strstr(path + 1, " d=\"");
+
+  munit_assert_not_null(path);
+  path += strlen(" d=\"");
+  size_t length = strchr(path, '"') - path;
+  char* outline = calloc(length + 1, 1);
+  memcpy(outline, path, length);
+  return outline;
+}
+
+MunitResult bands_leave_edges_that_stop_at_seams(const MunitParameter params[], void* userdata) {
+  enum { WIDTH = 24, HEIGHT = 16 };
+  byte pixels[WIDTH * HEIGHT * 3];
+  const byte top[3] = { 20, 200, 40 }, stripe[3] = { 250, 250, 250 }, bottom[3] = { 220, 40, 40 }, right[3] = { 90, 90, 240 };
+
+  // on the left a block stops right on the first seam and a stripe starts right under it, neither carries on over it.
+  // The right half and the block under the stripe do carry on over the seams.
+  for (int y = 0; y < HEIGHT; ++y) {
+    for (int x = 0; x < WIDTH; ++x) {
+      const byte* colour = x >= WIDTH / 2 ? right : y < 4 ? top : y == 4 ? stripe : bottom;
+      memcpy(&pixels[(x + y * WIDTH) * 3], colour, 3);
+    }
+  }
+  png_image blocks_png = { NULL, PNG_IMAGE_VERSION, WIDTH, HEIGHT, PNG_FORMAT_RGB };
+  munit_assert_true(png_image_write_to_file(&blocks_png, "./band_edges.png", 0, pixels, 0, NULL));
+  vectorize_options options = { "./band_edges.png", 1, 4, 256, 3, QUANTIZE_CHANNELS, 0, true, true };
+
+  NSVGimage* whole = dcdfill_chunkmap_for_nsvg(load_image_file_to_chunkmap(options), options);
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  munit_assert_true(write_svg_file(whole));
+  free_nsvg(whole);
+  long whole_length;
+  char* whole_svg = read_whole_file(OUTPUT_PATH, &whole_length);
+  char* top_outline = copy_svg_outline(whole_svg, 0); //the shapes go top left, right half, stripe, bottom left
+  char* stripe_outline = copy_svg_outline(whole_svg, 2);
+
+  munit_assert_true(vectorize_file_in_bands(options, dcdfill_find_shapes, (WIDTH + 2) * (4 + 2)));
+  munit_assert_int(getAndResetErrorCode(), ==, SUCCESS_CODE);
+  long banded_length;
+  char* banded_svg = read_whole_file(OUTPUT_PATH, &banded_length);
+
+  // neither moves over to meet a piece across the seam, they come out just like one map has them
+  munit_assert_not_null(strstr(banded_svg, top_outline));
+  munit_assert_not_null(strstr(banded_svg, stripe_outline));
+  int paths = 0;
+
+  for (char* path = strstr(banded_svg, "<path"); path; path = strstr(path + 1, "<path"))
+    ++paths;
+
+  // the block and the stripe, then a piece of the right half in every band and of the bottom block in all but the first
+  munit_assert_int(paths, ==, 2 + HEIGHT / 4 + (HEIGHT / 4 - 1));
+
+  free(top_outline);
+  free(stripe_outline);
+  free(whole_svg);
+  free(banded_svg);
+  return MUNIT_OK;
+}
+
+MunitResult task_pool_runs_every_task_once(const MunitParameter params[], void* userdata) {
+  enum { TASK_COUNT = 1000 };
+  int* runs = calloc(TASK_COUNT, sizeof(int));
+  int* sizes = calloc(TASK_COUNT, sizeof(int));
+
+  for (int i = 0; i < TASK_COUNT; ++i)
+    sizes[i] = (i * 7919) % 113;
+
+  run_tasks(7, TASK_COUNT, sizes, count_task_runs, runs);
+  run_tasks(1, TASK_COUNT, NULL, count_task_runs, runs);
+
+  for (int i = 0; i < TASK_COUNT; ++i)
+    munit_assert_int(runs[i], ==, 2);
+
+  free(sizes);
+  free(runs);
+  return MUNIT_OK;
+}
+
+MunitResult arena_gives_zeroed_aligned_memory(const MunitParameter params[], void* userdata) {
+  arena* allocator = create_arena();
+  arena* worker = create_arena();
+  char* previous = NULL;
+
+  for (int i = 1; i < 100000; i += 97) {
+    char* memory = arena_alloc(i % 2 ? allocator : worker, i);
+    munit_assert_ptr_not_null(memory);
+    munit_assert_int((uintptr_t)memory % 16, ==, 0);
+
+    for (int j = 0; j < i; ++j)
+      munit_assert_int(memory[j], ==, 0);
+
+    memset(memory, 0xff, i);
+    munit_assert_ptr_not_equal(memory, previous);
+    previous = memory;
+  }
+  merge_arenas(allocator, worker);
+  munit_assert_ptr_null(worker->blocks);
+  free_arena(worker);
+
+  reset_arena(allocator);
+  char* reused = arena_alloc(allocator, 1000);
+  munit_assert_int(reused[999], ==, 0);
+  free_arena(allocator);
+  return MUNIT_OK;
+}
+
 MunitResult just_run(const MunitParameter params[], void* userdata) {
   entrypoint(0, NULL);
 }
@@ -248,6 +1137,7 @@ int main(int argc, char** argv) {
   char* param3[] = { "1", NULL }; //max threshhold 440
   char* param4[] = { "./chunkmap.png", NULL };
   char* param5[] = { "256", NULL }; //max colours 256
+  char* jpeg_param[] = { "../../../../test/test.jpg", NULL };
   char* testname = argv[1];
 
   MunitParameterEnum test_params[] = { 
@@ -269,6 +1159,13 @@ int main(int argc, char** argv) {
     { NULL, NULL} 
   };
 
+  MunitParameterEnum jpeg_params[] = {
+    {
+      "filename", jpeg_param
+    },
+    { NULL, NULL }
+  };
+
   MunitTest apple = { "can_pass", aTestCanPass, NULL, NULL, MUNIT_TEST_OPTION_NONE };
   MunitTest orange = { "read_png", can_read_png, test2setup, test2teardown, MUNIT_TEST_OPTION_NONE, test_params };
   MunitTest mango = { "png_to_chunkmap", can_convert_png_to_chunkmap, test4setup, test4teardown, MUNIT_TEST_OPTION_NONE, test_params };
@@ -278,9 +1175,27 @@ int main(int argc, char** argv) {
   MunitTest banana = { "dcdfill", can_write_to_svgfile, test8setup, test8teardown, MUNIT_TEST_OPTION_NONE, test_params };
   MunitTest yo_mama = { "bobsweep", can_do_speedy_vectorize, speedy_vectorize_setup, speedy_vectorize_teardown, MUNIT_TEST_OPTION_NONE, test_params };
   MunitTest run = { "run", just_run, NULL, NULL, MUNIT_TEST_OPTION_NONE, test_params };
+  MunitTest kiwi = { "summed_area_table", summed_area_table_matches_direct_average, NULL, NULL, MUNIT_TEST_OPTION_NONE, test_params };
+  MunitTest lime = { "threaded_chunkmap", threaded_chunkmap_matches_single_thread, NULL, NULL, MUNIT_TEST_OPTION_NONE, test_params };
+  MunitTest plum = { "task_pool", task_pool_runs_every_task_once, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL };
+  MunitTest fig = { "arena", arena_gives_zeroed_aligned_memory, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL };
+  MunitTest pear = { "sweep_labels", sweep_labels_join_every_similar_neighbour, NULL, NULL, MUNIT_TEST_OPTION_NONE, test_params };
+  MunitTest pomelo = { "sweep_borders", sweep_borders_follow_shapes, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL };
+  MunitTest grape = { "similar_neighbours", similar_neighbours_match_colour_distance, NULL, NULL, MUNIT_TEST_OPTION_NONE, test_params };
+  MunitTest lemon = { "kernels", kernels_match_scalar, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL };
+  MunitTest apricot = { "palette", palette_quantizer_limits_colours, NULL, NULL, MUNIT_TEST_OPTION_NONE, test_params };
+  MunitTest papaya = { "palette_similarity", palette_indices_match_colour_similarity, NULL, NULL, MUNIT_TEST_OPTION_NONE, test_params };
+  MunitTest guava = { "quantize_chunks", quantizing_chunks_leaves_image_alone, NULL, NULL, MUNIT_TEST_OPTION_NONE, test_params };
+  MunitTest lychee = { "decode_to_chunks", decoding_to_chunks_matches_quantized_chunkmap, NULL, NULL, MUNIT_TEST_OPTION_NONE, test_params };
+  MunitTest quince = { "buffer_input", buffers_match_files, NULL, NULL, MUNIT_TEST_OPTION_NONE, test_params };
+  MunitTest date = { "png_stream", png_stream_matches_file, NULL, NULL, MUNIT_TEST_OPTION_NONE, test_params };
+  MunitTest olive = { "jpeg", jpeg_scaled_decoding_matches_chunks, NULL, NULL, MUNIT_TEST_OPTION_NONE, jpeg_params };
+  MunitTest kumquat = { "png_formats", png_formats_decode_to_rgb, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL };
+  MunitTest nectarine = { "bands", bands_stitch_shapes_across_seams, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL };
+  MunitTest tangerine = { "band_edges", bands_leave_edges_that_stop_at_seams, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL };
 
   enum { 
-    NUM_TESTS = 9 //UPDATE THIS WHEN YOU ADD NEW TESTS
+    NUM_TESTS = 27 //UPDATE THIS WHEN YOU ADD NEW TESTS
   }; 
 
   namedtest tests[NUM_TESTS] = {
@@ -293,6 +1208,24 @@ int main(int argc, char** argv) {
     {banana.name, banana},
     {yo_mama.name, yo_mama},
     {run.name, run},
+    {kiwi.name, kiwi},
+    {lime.name, lime},
+    {plum.name, plum},
+    {fig.name, fig},
+    {pear.name, pear},
+    {pomelo.name, pomelo},
+    {grape.name, grape},
+    {lemon.name, lemon},
+    {apricot.name, apricot},
+    {papaya.name, papaya},
+    {guava.name, guava},
+    {lychee.name, lychee},
+    {quince.name, quince},
+    {date.name, date},
+    {olive.name, olive},
+    {kumquat.name, kumquat},
+    {nectarine.name, nectarine},
+    {tangerine.name, tangerine},
   };
   MunitTest* filteredtests = filtertests(tests, NUM_TESTS, testname);
   MunitSuite suite = { "tests.", filteredtests };
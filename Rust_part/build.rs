@@ -30,13 +30,14 @@ const A_EXT: &'static str = ".a";
 const BAD_ZLIB: &'static str = "libz";
 const GOOD_ZLIB: &'static str = "zlib";
 const LIB_PNG: &'static str = "libpng16"; //windows and linux dont have the same package names from conan
+const LIB_JPEG: &'static str = "libjpeg";
 const LIB: &'static str = "lib";
-const NUM_LIBS: usize = 3;
+const NUM_LIBS: usize = 4;
 
 const TEMPLATE_NAME: &'static str = "template.svg";
 
 static LIB_NAMES: [&'static str; NUM_LIBS] = [
-    BAD_ZLIB, GOOD_ZLIB, LIB_PNG
+    BAD_ZLIB, GOOD_ZLIB, LIB_PNG, LIB_JPEG
 ];
 
 fn main() {
@@ -21,6 +21,7 @@ pub enum FfiResult {
     BadArgumentError,
     NotPngError,
     LowBoundariesCreated,
+    NotJpegError,
     UnknownError
 }
 
@@ -38,6 +39,7 @@ impl From<i32> for FfiResult {
             8 => FfiResult::BadArgumentError,
             9 => FfiResult::NotPngError,
             10 => FfiResult::LowBoundariesCreated,
+            11 => FfiResult::NotJpegError,
             _ => FfiResult::UnknownError
         }
     }
@@ -70,6 +72,7 @@ fn ffiresult_to_string(input: &FfiResult) -> &'static str {
         FfiResult::BadArgumentError => "BadArgumentError",
         FfiResult::NotPngError => "NotPngError",
         FfiResult::LowBoundariesCreated => "LowBoundariesCreated",
+        FfiResult::NotJpegError => "NotJpegError",
         FfiResult::UnknownError => "UnknownError"
     }
 }